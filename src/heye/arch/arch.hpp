@@ -11,17 +11,16 @@
 #include "cr.hpp"
 #include "dr.hpp"
 
+#include "heye/platform/instructions.hpp"
 #include "heye/shared/std/traits.hpp"
 
-#include <intrin.h>
-
 namespace heye
 {
 template<typename T> requires (!std::has_subleaf_v<T> && std::has_leaf_v<T>)
 inline T read()
 {
     T result{};
-    __cpuid(result.data, T::leaf);
+    platform::cpuid(result.data, T::leaf, 0);
     return result;
 }
 
@@ -29,32 +28,32 @@ template<typename T> requires (std::has_subleaf_v<T> && std::has_leaf_v<T>)
 inline T read()
 {
     T result{};
-    __cpuidex(result, T::leaf, T::subleaf);
+    platform::cpuid(result.data, T::leaf, T::subleaf);
     return result;
 }
 
 template<typename T> requires (std::has_id_v<T>)
-inline T read() { return T{ __readmsr(T::id) }; }
+inline T read() { return T{ platform::read_msr(T::id) }; }
 
 template<typename T> requires (std::has_id_v<T>)
-inline T read(uint32_t value) { return T{ __readmsr(value) };}
+inline T read(uint32_t value) { return T{ platform::read_msr(value) };}
 
 template<typename T> requires (std::has_id_v<T>)
-inline void write(T value) { __writemsr(T::id,  value.flags); }
+inline void write(T value) { platform::write_msr(T::id,  value.flags); }
 
 template<typename T> T    read()     { __debugbreak(); }
 template<typename T> void write(T v) { __debugbreak(); }
 
-template<> inline cr0_t read() { return cr0_t{ __readcr0() }; }
-template<> inline cr2_t read() { return cr2_t{ __readcr2() }; }
-template<> inline cr3_t read() { return cr3_t{ __readcr3() }; }
-template<> inline cr4_t read() { return cr4_t{ __readcr4() }; }
+template<> inline cr0_t read() { return cr0_t{ platform::read_cr(0) }; }
+template<> inline cr2_t read() { return cr2_t{ platform::read_cr(2) }; }
+template<> inline cr3_t read() { return cr3_t{ platform::read_cr(3) }; }
+template<> inline cr4_t read() { return cr4_t{ platform::read_cr(4) }; }
 
-template<> inline void write(cr0_t cr0) { __writecr0(cr0.flags); }
-template<> inline void write(cr3_t cr3) { __writecr3(cr3.flags); }
-template<> inline void write(cr4_t cr4) { __writecr4(cr4.flags); }
+template<> inline void write(cr0_t cr0) { platform::write_cr(0, cr0.flags); }
+template<> inline void write(cr3_t cr3) { platform::write_cr(3, cr3.flags); }
+template<> inline void write(cr4_t cr4) { platform::write_cr(4, cr4.flags); }
 
-template<> inline dr7_t read() { return dr7_t{ __readdr(7) }; }
+template<> inline dr7_t read() { return dr7_t{ platform::read_dr(7) }; }
 
 template<> inline gdtr_t read()
 {
@@ -83,13 +82,13 @@ template <> inline void write(idtr_t idtr)
 template<vmx::vmcs field> inline uint64_t read()
 {
     uint64_t value{};
-    __vmx_vmread(static_cast<uint64_t>(field), &value);
+    platform::vmread(static_cast<uint64_t>(field), &value);
     return value;
 }
 
 template<vmx::vmcs field> inline uint64_t write(uint64_t value)
 {
-    return __vmx_vmwrite(static_cast<uint64_t>(field), value);
+    return platform::vmwrite(static_cast<uint64_t>(field), value);
 }
 
 #define impl_read(name)                                                                 \
@@ -98,7 +97,7 @@ template<vmx::vmcs field> inline uint64_t write(uint64_t value)
         segment_t<name ##_t> segment{};                                                 \
         const auto selector = name ##_t{ asm_read_ ##name() };                          \
         segment.selector    = selector;                                                 \
-        segment.limit       = __segmentlimit(selector.flags);                           \
+        segment.limit       = platform::segment_limit(selector.flags);                  \
         segment.rights      = access_t                                                  \
         {                                                                               \
             .flags = static_cast<uint32_t>((asm_lar(selector.flags) >> 8) & 0xf0ff)     \
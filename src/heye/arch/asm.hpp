@@ -46,9 +46,20 @@ extern "C" uint64_t asm_invvpid(uint64_t, void*);
 ///
 extern "C" bool asm_vmcall(void*, void*, void*, void*);
 
-/// VMX vm-exit function.
+/// VMX vm-exit functions. Each one saves different guest state, see `exit_state_t`.
 ///
+extern "C" void vmexit_stub_gpr();
+extern "C" void vmexit_stub_sse_volatile();
 extern "C" void vmexit_stub();
+extern "C" void vmexit_stub_xsave();
+
+/// VMX vm-exit functions that resume hot exits without calling the handler
+/// and jump to the matching full stub otherwise.
+///
+extern "C" void vmexit_fast_gpr();
+extern "C" void vmexit_fast_sse_volatile();
+extern "C" void vmexit_fast();
+extern "C" void vmexit_fast_xsave();
 
 /// Launch vm. Return 0 on success meaning cpu executing now
 /// in non-root operation. return error code based on __vmx_vmlaunch intrinsic.
@@ -152,7 +152,7 @@ struct processor_features
                     uint32_t pdcm           : 1;
                     ///
                     ///
-                    uint32_t _reserved1     : 1;
+                    uint32_t _reserved3     : 1;
                     /// Process context identifiers (CR4 bit 17).
                     ///
                     uint32_t pcid           : 1;
@@ -239,7 +239,7 @@ struct processor_features
                     uint32_t apic       : 1;
                     ///
                     ///
-                    uint32_t _reserved1 : 1;
+                    uint32_t _reserved4 : 1;
                     /// SYSENTER and SYSEXIT instructions.
                     ///
                     uint32_t sep        : 1;
@@ -269,7 +269,7 @@ struct processor_features
                     uint32_t clfsh      : 1;
                     ///
                     ///
-                    uint32_t _reserved2 : 1;
+                    uint32_t _reserved5 : 1;
                     /// Debug store: save trace of executed jumps.
                     ///
                     uint32_t ds         : 1;
@@ -309,4 +309,71 @@ struct processor_features
     };
 };
 static_assert(sizeof(processor_features) == sizeof(uint32_t) * 4, "CPUID EAX=1 size mismatch");
+
+/// CPUID EAX=80000008h.
+///
+struct address_sizes
+{
+    static constexpr int leaf = static_cast<int>(0x80000008);
+
+    union
+    {
+        int data[4];
+
+        struct
+        {
+            union
+            {
+                uint32_t eax;
+
+                struct
+                {
+                    /// Number of physical address bits supported by the processor.
+                    ///
+                    uint32_t physical_address_bits : 8;
+                    /// Number of linear address bits supported by the processor.
+                    ///
+                    uint32_t linear_address_bits   : 8;
+                    /// @brief
+                    ///
+                    uint32_t _reserved1            : 16;
+                };
+            };
+
+            uint32_t ebx;
+            uint32_t ecx;
+            uint32_t edx;
+        };
+    };
+};
+static_assert(sizeof(address_sizes) == sizeof(uint32_t) * 4, "CPUID EAX=80000008h size mismatch");
+
+/// CPUID EAX=0Dh, ECX=0.
+///
+struct extended_state
+{
+    static constexpr int leaf = 0xd;
+
+    union
+    {
+        int data[4];
+
+        struct
+        {
+            /// Supported bits of XCR0 lower 32 bits.
+            ///
+            uint32_t xcr0_supported;
+            /// Size of XSAVE area required by features enabled in XCR0.
+            ///
+            uint32_t xsave_size_enabled;
+            /// Size of XSAVE area required by all supported features.
+            ///
+            uint32_t xsave_size;
+            /// Supported bits of XCR0 upper 32 bits.
+            ///
+            uint32_t xcr0_supported_high;
+        };
+    };
+};
+static_assert(sizeof(extended_state) == sizeof(uint32_t) * 4, "CPUID EAX=0Dh size mismatch");
 };
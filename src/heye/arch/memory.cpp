@@ -1,16 +1,61 @@
 #include "heye/arch/memory.hpp"
-
-#include <ntddk.h>
+#include "heye/platform/platform.hpp"
+#include "heye/shared/trace.hpp"
 
 namespace heye
 {
 uint64_t pa_from_va(const void* va)
 {
-    return static_cast<uint64_t>(MmGetPhysicalAddress((PVOID)va).QuadPart);
+    return platform::pa_from_va(va);
 }
 
 void* va_from_pa(uint64_t pa)
 {
-    return MmGetVirtualForPhysical({ .QuadPart = static_cast<LONGLONG>(pa) });
+    return platform::va_from_pa(pa);
+}
+
+memory_map_t::memory_map_t() : count(0), dropped(0)
+{
+    // Legacy ranges, PCI MMIO hole and local/IO APIC all live below 4GB, so first
+    // 4 gigabytes are always mapped. MMIO above 4GB is mapped on first access.
+    //
+    add(0, 4_gb);
+
+    platform::physical_ranges([](void* context, uint64_t base, uint64_t size)
+    {
+        static_cast<memory_map_t*>(context)->add(base, size);
+    }, this);
+
+    if (dropped != 0)
+        logger::warn("Memory map truncated, %ld ranges beyond %ld are not mapped", dropped, static_cast<size_t>(max_ranges));
+}
+
+void memory_map_t::add(uint64_t base, uint64_t size)
+{
+    if (count < max_ranges)
+    {
+        ranges[count].base = base;
+        ranges[count].size = size;
+        count++;
+    }
+    else
+    {
+        dropped++;
+    }
+}
+
+void* allocate_contiguous(size_t size)
+{
+    return platform::allocate_contiguous(size, platform::any_node);
+}
+
+void* allocate_contiguous(size_t size, uint32_t node)
+{
+    return platform::allocate_contiguous(size, node);
+}
+
+void free_contiguous(void* va)
+{
+    platform::free_contiguous(va);
 }
 };
@@ -1,6 +1,7 @@
 #pragma once
 #include "heye/config.hpp"
 
+#include <cstddef>
 #include <cstdint>
 
 namespace heye
@@ -14,13 +15,55 @@ enum memory_type_t
     write_back      = 6
 };
 
-inline uint64_t operator""_kb(uint64_t size) { return size * 1024;    }
-inline uint64_t operator""_mb(uint64_t size) { return size * 1024_kb; }
-inline uint64_t operator""_gb(uint64_t size) { return size * 1024_mb; }
+inline uint64_t operator""_kb(unsigned long long size) { return size * 1024;    }
+inline uint64_t operator""_mb(unsigned long long size) { return size * 1024_kb; }
+inline uint64_t operator""_gb(unsigned long long size) { return size * 1024_mb; }
 
 
 inline uint64_t pfn(uint64_t pa) { return pa >> page_shift; }
 
 uint64_t pa_from_va(const void* va);
 void*    va_from_pa(uint64_t    pa);
+
+struct memory_range_t
+{
+    uint64_t base;
+    uint64_t size;
+};
+
+/// Physical address ranges that must be identity mapped: RAM reported by the memory manager
+/// and MMIO below 4GB.
+///
+struct memory_map_t
+{
+    memory_map_t();
+
+    /// Helper functions for `for` iterator.
+    ///
+    auto   begin() const { return &ranges[0];     }
+    auto   end()   const { return &ranges[count]; }
+    size_t size()  const { return count;          }
+
+private:
+    void add(uint64_t base, uint64_t size);
+
+    static constexpr auto max_ranges = 128;
+
+    memory_range_t ranges[max_ranges];
+    size_t         count;
+
+    /// Ranges that didn't fit, reported once the map is built.
+    ///
+    size_t         dropped;
+};
+
+/// Allocate physically contiguous non-paged memory. Returns `nullptr` on failure.
+///
+void* allocate_contiguous(size_t size);
+void  free_contiguous(void* va);
+
+/// Allocate zeroed, page aligned, physically contiguous non-paged memory, preferably from
+/// the NUMA node. Falls back to other nodes. Free with `free_contiguous`.
+///
+void* allocate_contiguous(size_t size, uint32_t node);
 };
@@ -678,6 +678,23 @@ struct vmx_procbased_controls2
 
 };
 
+struct vmx_vmfunc
+{
+    static constexpr unsigned id = 0x491;
+
+    union
+    {
+        uint64_t flags;
+
+        struct
+        {
+            /// VMFUNC leaf 0 switches EPTP to one of the entries of the EPTP list.
+            ///
+            uint64_t eptp_switching : 1;
+        };
+    };
+};
+
 struct vmx_true_pinbased_controls
 {
     static constexpr unsigned id = 0x48d;
@@ -3,22 +3,50 @@
 
 namespace heye
 {
-mtrr_descriptor::mtrr_descriptor() : variable_available(0)
+/// Memory type values are ordered by strength: UC < WC < WT < WP < WB.
+///
+static memory_type_t strongest(memory_type_t lhs, memory_type_t rhs)
 {
+    return lhs < rhs ? lhs : rhs;
+}
+
+template<typename T> requires (std::has_id_v<T>)
+void mtrr_descriptor::build_mtrr(uint64_t& index)
+{
+    uint64_t offset{};
+
+    for (auto type : read<T>().types)
+    {
+        ranges[index].type = static_cast<memory_type_t>(type);
+        ranges[index].base = T::base + offset;
+        ranges[index].size = T::size;
+        index  += 1;
+        offset += T::size;
+    }
+}
+
+mtrr_descriptor::mtrr_descriptor() : fixed_available(0), variable_available(0), interval_count(0)
+{
+    default_memory_type = static_cast<memory_type_t>(read<msr::mtrr_def_type>().memory_type);
+
     uint64_t index{};
     // Fill fixed range mtrr first.
     //
-    build_mtrr<msr::mtrr_fix_64k>  (index);
-    build_mtrr<msr::mtrr_fix_16k_0>(index);
-    build_mtrr<msr::mtrr_fix_16k_1>(index);
-    build_mtrr<msr::mtrr_fix_4k_0> (index);
-    build_mtrr<msr::mtrr_fix_4k_1> (index);
-    build_mtrr<msr::mtrr_fix_4k_2> (index);
-    build_mtrr<msr::mtrr_fix_4k_3> (index);
-    build_mtrr<msr::mtrr_fix_4k_4> (index);
-    build_mtrr<msr::mtrr_fix_4k_5> (index);
-    build_mtrr<msr::mtrr_fix_4k_6> (index);
-    build_mtrr<msr::mtrr_fix_4k_7> (index);
+    if (read<msr::mtrrcap>().fix && read<msr::mtrr_def_type>().fixed_range_mtrr_enable)
+    {
+        build_mtrr<msr::mtrr_fix_64k>  (index);
+        build_mtrr<msr::mtrr_fix_16k_0>(index);
+        build_mtrr<msr::mtrr_fix_16k_1>(index);
+        build_mtrr<msr::mtrr_fix_4k_0> (index);
+        build_mtrr<msr::mtrr_fix_4k_1> (index);
+        build_mtrr<msr::mtrr_fix_4k_2> (index);
+        build_mtrr<msr::mtrr_fix_4k_3> (index);
+        build_mtrr<msr::mtrr_fix_4k_4> (index);
+        build_mtrr<msr::mtrr_fix_4k_5> (index);
+        build_mtrr<msr::mtrr_fix_4k_6> (index);
+        build_mtrr<msr::mtrr_fix_4k_7> (index);
+        fixed_available = index;
+    }
     // Fill variable range mtrr.
     //
     for (int i = 0; i < read<msr::mtrrcap>().vnct; i++)
@@ -31,28 +59,142 @@ mtrr_descriptor::mtrr_descriptor() : variable_available(0)
             unsigned long length{};
             _BitScanForward64(&length, physmask.pfn);
 
-            mtrr[index + variable_available].type = static_cast<memory_type_t>(physbase.type);
-            mtrr[index + variable_available].base = (physbase.pfn << page_shift);
-            mtrr[index + variable_available].size = (physbase.pfn + (1ull << length)) << page_shift;
+            ranges[index + variable_available].type = static_cast<memory_type_t>(physbase.type);
+            ranges[index + variable_available].base = (physbase.pfn << page_shift);
+            ranges[index + variable_available].size = (1ull << length) << page_shift;
             variable_available++;
         }
     }
+    compile();
 }
 
 memory_type_t mtrr_descriptor::get_type_or(uint64_t pa, memory_type_t def) const
 {
-    for (const auto& range : *this)
+    return get_range_type_or(pa, 2_mb, def).type;
+}
+
+mtrr_range_type mtrr_descriptor::get_range_type_or(uint64_t pa, uint64_t size, memory_type_t def) const
+{
+    // Binary search for the first interval that ends after `pa`.
+    //
+    size_t low  = 0;
+    size_t high = interval_count;
+    while (low < high)
+    {
+        const auto middle = (low + high) / 2;
+        if (intervals[middle].base + intervals[middle].size <= pa)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    mtrr_range_type result{ def, true };
+    bool first = true;
+
+    for (auto cursor = pa, end = pa + size; cursor < end;)
+    {
+        memory_type_t type{};
+        uint64_t      next{};
+
+        if (low < interval_count && intervals[low].base <= cursor)
+        {
+            type = intervals[low].type;
+            next = intervals[low].base + intervals[low].size;
+            low++;
+        }
+        else
+        {
+            // Gap between intervals.
+            //
+            type = def;
+            next = low < interval_count ? intervals[low].base : end;
+        }
+
+        if (first)
+        {
+            result.type = type;
+            first = false;
+        }
+        else if (type != result.type)
+        {
+            result.type    = strongest(result.type, type);
+            result.uniform = false;
+        }
+        cursor = next < end ? next : end;
+    }
+    return result;
+}
+
+void mtrr_descriptor::compile()
+{
+    const auto count = fixed_available + variable_available;
+    // Collect range boundaries and sort them.
+    //
+    size_t boundary_count{};
+    for (size_t i = 0; i < count; i++)
+    {
+        boundaries[boundary_count++] = ranges[i].base;
+        boundaries[boundary_count++] = ranges[i].base + ranges[i].size;
+    }
+
+    for (size_t i = 1; i < boundary_count; i++)
+    {
+        const auto value = boundaries[i];
+        auto j = i;
+        for (; j > 0 && boundaries[j - 1] > value; j--)
+        {
+            boundaries[j] = boundaries[j - 1];
+        }
+        boundaries[j] = value;
+    }
+    // Resolve each elementary segment between two boundaries and merge neighbours of the same type.
+    //
+    for (size_t i = 0; i + 1 < boundary_count; i++)
+    {
+        const auto base = boundaries[i];
+        const auto end  = boundaries[i + 1];
+
+        memory_type_t type{};
+        if (base == end || !resolve(base, type))
+            continue;
+
+        auto last = interval_count ? &intervals[interval_count - 1] : nullptr;
+        if (last != nullptr && last->base + last->size == base && last->type == type)
+        {
+            last->size += end - base;
+        }
+        else
+        {
+            intervals[interval_count++] = mtrr_range{ base, end - base, type };
+        }
+    }
+    logger::info<logger::category_t::mtrr>("MTRR compiled into %lld intervals", interval_count);
+}
+
+bool mtrr_descriptor::resolve(uint64_t pa, memory_type_t& type) const
+{
+    // Fixed ranges take priority over variable ranges for the first megabyte.
+    //
+    for (size_t i = 0; i < fixed_available; i++)
+    {
+        if (pa >= ranges[i].base && pa < ranges[i].base + ranges[i].size)
+        {
+            type = ranges[i].type;
+            return true;
+        }
+    }
+    // If variable ranges overlap, UC wins and WT takes precedence over WB.
+    // Other overlaps are undefined, so the strongest type is used.
+    //
+    bool found = false;
+    for (size_t i = fixed_available; i < fixed_available + variable_available; i++)
     {
-        if (pa < range.base + range.size)
+        if (pa >= ranges[i].base && pa < ranges[i].base + ranges[i].size)
         {
-            if (pa + 2_mb - 1 >= range.base)
-            {
-                def = range.type;
-                if (def == memory_type_t::uncachable)
-                    break;
-            }
+            type  = found ? strongest(type, ranges[i].type) : ranges[i].type;
+            found = true;
         }
     }
-    return def;
+    return found;
 }
 };
@@ -13,35 +13,56 @@ struct mtrr_range
     memory_type_t type;
 };
 
+struct mtrr_range_type
+{
+    /// Strongest memory type found in the range.
+    ///
+    memory_type_t type;
+    /// Set if the whole range has the same memory type.
+    ///
+    bool          uniform;
+};
+
+/// MTRR ranges compiled into sorted, non-overlapping intervals with SDM precedence rules
+/// ("11.11.4.1 MTRR Precedences") already applied, so lookups are a binary search.
+///
 struct mtrr_descriptor
 {
     mtrr_descriptor();
 
-    /// Helper functions for `for` iterator.
+    /// Helper functions for `for` iterator over compiled intervals.
+    ///
+    auto   begin() const { return &intervals[0];              }
+    auto   end()   const { return &intervals[interval_count]; }
+    size_t size()  const { return interval_count;             }
+
+    /// Memory type of addresses not covered by any MTRR, from `IA32_MTRR_DEF_TYPE`.
     ///
-    auto   begin() const { return &mtrr[0];                         }
-    auto   end()   const { return &mtrr[size()];                    }
-    size_t size()  const { return fixed_count + variable_available; }
+    memory_type_t default_type() const { return default_memory_type; }
 
-    /// Get memory type of the physical address, return default if not found.
+    /// Get memory type of the 2MB page at physical address, return default if not found.
+    /// If page has mixed memory types, the strongest one is returned.
     ///
     memory_type_t get_type_or(uint64_t pa, memory_type_t def) const;
 
+    /// Get memory type of the physical range. Addresses not covered by any MTRR get default type.
+    /// If range has mixed memory types, the strongest one is returned and `uniform` is cleared.
+    ///
+    mtrr_range_type get_range_type_or(uint64_t pa, uint64_t size, memory_type_t def) const;
+
 private:
+    /// Append ranges of the fixed range MTRR `T`.
+    ///
     template<typename T> requires (std::has_id_v<T>)
-    void build_mtrr(auto& index)
-    {
-        uint64_t offset{};
-
-        for (auto type : read<T>().types)
-        {
-            mtrr[index].type = static_cast<memory_type_t>(type);
-            mtrr[index].base = T::base + offset;
-            mtrr[index].size = T::size + T::base + offset;
-            index  += 1;
-            offset += T::size;
-        }
-    };
+    void build_mtrr(uint64_t& index);
+
+    /// Build sorted intervals from raw fixed and variable ranges.
+    ///
+    void compile();
+
+    /// Resolve memory type of the address from raw ranges. Returns `false` if not covered.
+    ///
+    bool resolve(uint64_t pa, memory_type_t& type) const;
 
     /// Architecture defined number of fixed mtrr registers.
     /// 1 register for 64k, 2 registers for 16k and 8 registers for 4k.
@@ -49,18 +70,26 @@ private:
     ///
     static constexpr auto fixed_count    = (1 + 2 + 8) * 8;
     static constexpr auto variable_count = 255;
+    static constexpr auto range_count    = fixed_count + variable_count;
+    /// Every range adds at most 2 boundaries.
+    ///
+    static constexpr auto max_intervals  = range_count * 2;
 
-    union
-    {
-        struct
-        {
-            mtrr_range fixed[fixed_count];
-            mtrr_range variable[variable_count];
-        };
+    memory_type_t default_memory_type;
 
-        mtrr_range mtrr[fixed_count + variable_count];
-    };
+    /// Raw ranges, fixed ranges first.
+    ///
+    mtrr_range ranges[range_count];
+    size_t     fixed_available;
+    size_t     variable_available;
 
-    size_t variable_available;
+    /// Sorted, non-overlapping intervals.
+    ///
+    mtrr_range intervals[max_intervals];
+    size_t     interval_count;
+
+    /// Scratch space for interval boundaries.
+    ///
+    uint64_t   boundaries[max_intervals];
 };
 };
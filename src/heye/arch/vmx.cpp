@@ -5,7 +5,7 @@ namespace heye::vmx
 {
 void invept(vmx::invept_t type, uint64_t eptp)
 {
-    vmx::invept_desc_t descriptor{ .eptp = eptp };
+    vmx::invept_desc_t descriptor{ .eptp = eptp, .reserved = 0 };
     asm_invept(static_cast<uint64_t>(type), &descriptor);
 }
 
@@ -47,6 +47,8 @@ enum class vmcs : uint64_t
     vm_entry_msr_load_addr_high   = 0x0000200b,
     executive_vmcs_pointer        = 0x0000200c,
     executive_vmcs_pointer_high   = 0x0000200d,
+    pml_address                   = 0x0000200e,
+    pml_address_high              = 0x0000200f,
     tsc_offset                    = 0x00002010,
     tsc_offset_high               = 0x00002011,
     virtual_apic_page_addr        = 0x00002012,
@@ -264,6 +266,7 @@ enum class exit_reason : uint64_t
     apic_write                   = 56,
     rdrand                       = 57,
     invpcid                      = 58,
+    vmfunc                       = 59,
     rdseed                       = 61,
     pml_full                     = 62,
     xsaves                       = 63,
@@ -550,7 +553,7 @@ struct exit_qualification_ept_violation_t
 
 /// https://github.com/wbenny/hvpp/blob/84b3f3c241e1eec3ab42f75cad9deef3ad67e6ab/src/hvpp/hvpp/ia32/vmx/exit_qualification.h#L157
 ///
-struct exit_qualification_t
+union exit_qualification_t
 {
     // For INVEPT, INVPCID, INVVPID, LGDT, LIDT, LLDT, LTR, SGDT, SIDT,
     // SLDT, STR, VMCLEAR, VMPTRLD, VMPTRST, VMREAD, VMWRITE, VMXON,
@@ -7,11 +7,19 @@ VMX_ERROR_CODE_FAILED             = 2
 VMCS_GUEST_RSP     = 0681Ch
 VMCS_GUEST_RIP     = 0681Eh
 VMCS_GUEST_RFLAGS  = 06820h
+VMCS_GUEST_CR4     = 06804h
+VMCS_EXIT_REASON   = 04402h
+VMCS_EXIT_INST_LEN = 0440Ch
+
 KGDT64_R3_DATA     = 00028h
 KGDT64_R3_CODE     = 00030h
 RPL_MASK           = 00003h
 SHADOW_SPACE_SIZE  = 00020h
 
+EXIT_REASON_CPUID  = 10
+EXIT_REASON_VMCALL = 18
+VMCALL_PING        = 0
+
 ; Defined in cpu.hpp.
 regs_t struct
     ; General-purpose registers.
@@ -61,26 +69,39 @@ frame_t struct
     $ss     qword ?
 frame_t ends
 
-vmexit_stub proc frame
-    ; Create trap frame for stack traces.
-    sub    rsp, 8 + sizeof frame_t
-    push   rax
-    mov    frame_t.$ss[rsp + 8], KGDT64_R3_DATA or RPL_MASK
-    mov    rax, VMCS_GUEST_RSP
-    vmread frame_t.$rsp[rsp + 8], rax
-    mov    rax, VMCS_GUEST_RFLAGS
-    vmread frame_t.$rflags[rsp + 8], rax
-    mov    frame_t.$cs[rsp + 8], KGDT64_R3_CODE or RPL_MASK
-    mov    rax, VMCS_GUEST_RIP
-    vmread frame_t.$rip[rsp + 8], rax
-    pop    rax
-    .pushframe
+; Defined in fastpath.hpp
+cpuid_entry_t struct
+    $leaf     dword ?
+    $subleaf  dword ?
+    $indexed  dword ?
+    $cr4_bit  byte  ?
+    $ecx_bit  byte  ?
+    $reserved word  ?
+    $eax      dword ?
+    $ebx      dword ?
+    $ecx      dword ?
+    $edx      dword ?
+cpuid_entry_t ends
 
-    sub    rsp, sizeof regs_t
-    .allocstack sizeof regs_t + SHADOW_SPACE_SIZE
-    .endprolog
+MAX_CACHED_CPUID = 16
 
-    ; General-purpose registers.
+exit_cache_t struct
+    $cpuid_count dword ?
+    $ping        dword ?
+    $reserved    dword 2 dup (?)
+    $cpuid       cpuid_entry_t MAX_CACHED_CPUID dup (<>)
+exit_cache_t ends
+
+; Offset of `stack_t::exit_tsc` from the host rsp.
+EXIT_TSC_OFFSET = 18h
+
+; Guest register state saved by the stub, see `exit_state_t` in callbacks.hpp.
+EXIT_STATE_GPR          = 0
+EXIT_STATE_SSE_VOLATILE = 1
+EXIT_STATE_SSE          = 2
+EXIT_STATE_XSAVE        = 3
+
+SAVE_GPR macro
     mov    regs_t.$rax[rsp], rax
     mov    regs_t.$rcx[rsp], rcx
     mov    regs_t.$rbx[rsp], rbx
@@ -97,20 +118,38 @@ vmexit_stub proc frame
     mov    regs_t.$r13[rsp], r13
     mov    regs_t.$r14[rsp], r14
     mov    regs_t.$r15[rsp], r15
+endm
 
-    mov    rax, VMCS_GUEST_RSP
-    vmread regs_t.$rsp[rsp], rax
-    mov    rax, VMCS_GUEST_RIP
-    vmread regs_t.$rip[rsp], rax
-    mov    rax, VMCS_GUEST_RFLAGS
-    vmread regs_t.$rflags[rsp], rax
-    ; SSE registers.
+; Guest rsp is restored from vmcs.
+RESTORE_GPR macro
+    mov    rax, regs_t.$rax[rsp]
+    mov    rcx, regs_t.$rcx[rsp]
+    mov    rdx, regs_t.$rdx[rsp]
+    mov    rbx, regs_t.$rbx[rsp]
+    mov    rbp, regs_t.$rbp[rsp]
+    mov    rsi, regs_t.$rsi[rsp]
+    mov    rdi, regs_t.$rdi[rsp]
+    mov    r8,  regs_t.$r8[rsp]
+    mov    r9,  regs_t.$r9[rsp]
+    mov    r10, regs_t.$r10[rsp]
+    mov    r11, regs_t.$r11[rsp]
+    mov    r12, regs_t.$r12[rsp]
+    mov    r13, regs_t.$r13[rsp]
+    mov    r14, regs_t.$r14[rsp]
+    mov    r15, regs_t.$r15[rsp]
+endm
+
+; Handler may clobber only xmm0-xmm5, the rest is preserved by the calling convention.
+SAVE_XMM_VOLATILE macro
     movaps regs_t.$xmm0[rsp],  xmm0
     movaps regs_t.$xmm1[rsp],  xmm1
     movaps regs_t.$xmm2[rsp],  xmm2
     movaps regs_t.$xmm3[rsp],  xmm3
     movaps regs_t.$xmm4[rsp],  xmm4
     movaps regs_t.$xmm5[rsp],  xmm5
+endm
+
+SAVE_XMM_NONVOLATILE macro
     movaps regs_t.$xmm6[rsp],  xmm6
     movaps regs_t.$xmm7[rsp],  xmm7
     movaps regs_t.$xmm8[rsp],  xmm8
@@ -121,28 +160,18 @@ vmexit_stub proc frame
     movaps regs_t.$xmm13[rsp], xmm13
     movaps regs_t.$xmm14[rsp], xmm14
     movaps regs_t.$xmm15[rsp], xmm15
-    ; Make shadow space.
-    sub    rsp, SHADOW_SPACE_SIZE
-    ; Load vcpu pointer.
-    mov    rcx, [rsp + 30h + sizeof frame_t + sizeof regs_t]
-    ; Call vmexit handler.
-    call   qword ptr [rsp + 28h + sizeof frame_t + sizeof regs_t]
+endm
 
-    add    rsp, SHADOW_SPACE_SIZE
-
-    cmp    al, 1
-    je     vmxoff_stub
-
-    vmresume
-    jmp    @error
-
-vmxoff_stub:
+RESTORE_XMM_VOLATILE macro
     movaps xmm0,  regs_t.$xmm0[rsp]
     movaps xmm1,  regs_t.$xmm1[rsp]
     movaps xmm2,  regs_t.$xmm2[rsp]
     movaps xmm3,  regs_t.$xmm3[rsp]
     movaps xmm4,  regs_t.$xmm4[rsp]
     movaps xmm5,  regs_t.$xmm5[rsp]
+endm
+
+RESTORE_XMM_NONVOLATILE macro
     movaps xmm6,  regs_t.$xmm6[rsp]
     movaps xmm7,  regs_t.$xmm7[rsp]
     movaps xmm8,  regs_t.$xmm8[rsp]
@@ -153,22 +182,106 @@ vmxoff_stub:
     movaps xmm13, regs_t.$xmm13[rsp]
     movaps xmm14, regs_t.$xmm14[rsp]
     movaps xmm15, regs_t.$xmm15[rsp]
+endm
 
-    mov    rax, regs_t.$rax[rsp]
-    mov    rcx, regs_t.$rcx[rsp]
-    mov    rdx, regs_t.$rdx[rsp]
-    mov    rbx, regs_t.$rbx[rsp]
-    mov    rbp, regs_t.$rbp[rsp]
-    mov    rsi, regs_t.$rsi[rsp]
-    mov    rdi, regs_t.$rdi[rsp]
-    mov    r8,  regs_t.$r8[rsp]
-    mov    r9,  regs_t.$r9[rsp]
-    mov    r10, regs_t.$r10[rsp]
-    mov    r11, regs_t.$r11[rsp]
-    mov    r12, regs_t.$r12[rsp]
-    mov    r13, regs_t.$r13[rsp]
-    mov    r14, regs_t.$r14[rsp]
-    mov    r15, regs_t.$r15[rsp]
+; Extended state area pointer lives in `stack_t::xsave_area` right above the trap frame.
+; General purpose registers are already saved, so rax, rcx and rdx are free.
+SAVE_XSTATE macro
+    mov    rcx, [rsp + sizeof regs_t + sizeof frame_t]
+    mov    eax, -1
+    mov    edx, -1
+    xsave64 [rcx]
+endm
+
+RESTORE_XSTATE macro
+    mov    rcx, [rsp + sizeof regs_t + sizeof frame_t]
+    mov    eax, -1
+    mov    edx, -1
+    xrstor64 [rcx]
+endm
+
+SAVE_STATE macro state
+    if state eq EXIT_STATE_SSE_VOLATILE
+        SAVE_XMM_VOLATILE
+    elseif state eq EXIT_STATE_SSE
+        SAVE_XMM_VOLATILE
+        SAVE_XMM_NONVOLATILE
+    elseif state eq EXIT_STATE_XSAVE
+        SAVE_XSTATE
+    endif
+endm
+
+RESTORE_STATE macro state
+    if state eq EXIT_STATE_SSE_VOLATILE
+        RESTORE_XMM_VOLATILE
+    elseif state eq EXIT_STATE_SSE
+        RESTORE_XMM_VOLATILE
+        RESTORE_XMM_NONVOLATILE
+    elseif state eq EXIT_STATE_XSAVE
+        RESTORE_XSTATE
+    endif
+endm
+
+; Vm exit entry point. Saves general purpose registers and the extended state
+; requested by `state`, then calls the handler stored on the host stack.
+VMEXIT_STUB macro name, state
+name proc frame
+    ; Create trap frame for stack traces.
+    sub    rsp, 8 + sizeof frame_t
+    push   rax
+    mov    frame_t.$ss[rsp + 8], KGDT64_R3_DATA or RPL_MASK
+    mov    rax, VMCS_GUEST_RSP
+    vmread frame_t.$rsp[rsp + 8], rax
+    mov    rax, VMCS_GUEST_RFLAGS
+    vmread frame_t.$rflags[rsp + 8], rax
+    mov    frame_t.$cs[rsp + 8], KGDT64_R3_CODE or RPL_MASK
+    mov    rax, VMCS_GUEST_RIP
+    vmread frame_t.$rip[rsp + 8], rax
+    pop    rax
+    .pushframe
+
+    sub    rsp, sizeof regs_t
+    .allocstack sizeof regs_t + SHADOW_SPACE_SIZE
+    .endprolog
+
+    ; General-purpose registers.
+    SAVE_GPR
+
+    ; Exit timestamp of the latency statistics, kept in `stack_t::exit_tsc`.
+    rdtsc
+    shl    rdx, 32
+    or     rax, rdx
+    mov    [rsp + sizeof regs_t + sizeof frame_t + 8 + EXIT_TSC_OFFSET], rax
+
+    mov    rax, VMCS_GUEST_RSP
+    vmread regs_t.$rsp[rsp], rax
+    mov    rax, VMCS_GUEST_RIP
+    vmread regs_t.$rip[rsp], rax
+    mov    rax, VMCS_GUEST_RFLAGS
+    vmread regs_t.$rflags[rsp], rax
+
+    SAVE_STATE state
+    ; Make shadow space.
+    sub    rsp, SHADOW_SPACE_SIZE
+    ; Load vcpu pointer.
+    mov    rcx, [rsp + 30h + sizeof frame_t + sizeof regs_t]
+    ; Call vmexit handler.
+    call   qword ptr [rsp + 28h + sizeof frame_t + sizeof regs_t]
+
+    add    rsp, SHADOW_SPACE_SIZE
+
+    cmp    al, 1
+    je     vmxoff_stub
+
+    RESTORE_STATE state
+    RESTORE_GPR
+
+    vmresume
+    jmp    @error
+
+vmxoff_stub:
+    RESTORE_STATE state
+    RESTORE_GPR
     mov    rcx, regs_t.$rip[rsp]
     mov    rdx, regs_t.$rsp[rsp]
 
@@ -183,7 +296,108 @@ vmxoff_stub:
 
 @error:
     int 3
-vmexit_stub endp
+name endp
+endm
+
+; Offset of `stack_t::regs` from the host rsp.
+REGS_OFFSET = 8 + sizeof frame_t + sizeof regs_t
+; Offset of `stack_t::exit_cache` from the host rsp.
+EXIT_CACHE_OFFSET = 10h
+
+; Vm exit entry point that resumes cached CPUID and ping VMCALL exits right away.
+; Only r8 and r9 are used as scratch registers and they are kept in their `regs_t`
+; slots, so the full stub can take over any other exit unchanged.
+VMEXIT_FAST_STUB macro name, stub
+name proc
+    mov    regs_t.$r8[rsp - REGS_OFFSET], r8
+    mov    regs_t.$r9[rsp - REGS_OFFSET], r9
+
+    mov    r8, VMCS_EXIT_REASON
+    vmread r9, r8
+    movzx  r9d, r9w
+    mov    r8, [rsp + EXIT_CACHE_OFFSET]
+
+    cmp    r9d, EXIT_REASON_CPUID
+    je     cpuid_exit
+    cmp    r9d, EXIT_REASON_VMCALL
+    jne    slow_path
+
+    ; vmcall reason is passed in rcx.
+    cmp    rcx, VMCALL_PING
+    jne    slow_path
+    cmp    exit_cache_t.$ping[r8], 0
+    je     slow_path
+    jmp    skip_instruction
+
+cpuid_exit:
+    mov    r9d, exit_cache_t.$cpuid_count[r8]
+    lea    r8,  exit_cache_t.$cpuid[r8]
+cpuid_next:
+    test   r9d, r9d
+    jz     slow_path
+    cmp    eax, cpuid_entry_t.$leaf[r8]
+    jne    cpuid_skip
+    cmp    cpuid_entry_t.$indexed[r8], 0
+    je     cpuid_hit
+    cmp    ecx, cpuid_entry_t.$subleaf[r8]
+    je     cpuid_hit
+cpuid_skip:
+    add    r8, sizeof cpuid_entry_t
+    dec    r9d
+    jmp    cpuid_next
+cpuid_hit:
+    ; 32-bit moves clear upper halves just like cpuid does.
+    mov    ecx, cpuid_entry_t.$ecx[r8]
+    movzx  r9d, cpuid_entry_t.$cr4_bit[r8]
+    test   r9d, r9d
+    jz     cpuid_load
+    ; Bit mirrors guest CR4, which may have changed since the leaf was cached.
+    ; rax is free until the result is loaded below.
+    mov    rax, VMCS_GUEST_CR4
+    vmread rax, rax
+    bt     rax, r9
+    movzx  r9d, cpuid_entry_t.$ecx_bit[r8]
+    jc     cpuid_set
+    btr    ecx, r9d
+    jmp    cpuid_load
+cpuid_set:
+    bts    ecx, r9d
+cpuid_load:
+    mov    eax, cpuid_entry_t.$eax[r8]
+    mov    ebx, cpuid_entry_t.$ebx[r8]
+    mov    edx, cpuid_entry_t.$edx[r8]
+    jmp    skip_instruction
+
+skip_instruction:
+    mov    r8, VMCS_GUEST_RIP
+    vmread r9, r8
+    mov    r8, VMCS_EXIT_INST_LEN
+    vmread r8, r8
+    add    r9, r8
+    mov    r8, VMCS_GUEST_RIP
+    vmwrite r8, r9
+
+    mov    r8, regs_t.$r8[rsp - REGS_OFFSET]
+    mov    r9, regs_t.$r9[rsp - REGS_OFFSET]
+    vmresume
+    int 3
+
+slow_path:
+    mov    r8, regs_t.$r8[rsp - REGS_OFFSET]
+    mov    r9, regs_t.$r9[rsp - REGS_OFFSET]
+    jmp    stub
+name endp
+endm
+
+VMEXIT_STUB vmexit_stub_gpr,          EXIT_STATE_GPR
+VMEXIT_STUB vmexit_stub_sse_volatile, EXIT_STATE_SSE_VOLATILE
+VMEXIT_STUB vmexit_stub,              EXIT_STATE_SSE
+VMEXIT_STUB vmexit_stub_xsave,        EXIT_STATE_XSAVE
+
+VMEXIT_FAST_STUB vmexit_fast_gpr,          vmexit_stub_gpr
+VMEXIT_FAST_STUB vmexit_fast_sse_volatile, vmexit_stub_sse_volatile
+VMEXIT_FAST_STUB vmexit_fast,              vmexit_stub
+VMEXIT_FAST_STUB vmexit_fast_xsave,        vmexit_stub_xsave
 
 asm_vmlaunch proc
     mov     rcx, VMCS_GUEST_RSP
@@ -4,4 +4,48 @@ static constexpr auto max_cpu_count     = 256;
 static constexpr auto pool_tag          = 'heye';
 static constexpr auto page_size         = 0x1000;
 static constexpr auto page_shift        = 12;
+static constexpr auto cache_line_size   = 64;
 static constexpr auto kernel_stack_size = 6 * page_size;
+/// Map gigabytes with uniform memory type using 1GB EPT pages when supported by the cpu.
+///
+static constexpr auto ept_use_1gb_pages = true;
+/// Number of 4KB tables preallocated for splitting EPT large pages in vmx root.
+///
+static constexpr auto ept_pool_size     = 256;
+/// Number of dirty guest physical addresses buffered per vcpu when page modification logging is enabled.
+///
+static constexpr auto pml_ring_size     = 4096;
+/// Number of objects kept in the per processor cache of every slab allocator.
+///
+static constexpr auto slab_cache_size   = 32;
+/// Number of EPT hooks and their shadow pages reserved at hypervisor construction.
+///
+static constexpr auto ept_hook_count    = 256;
+/// Number of guest physical pages that can have EPT violation handlers. Must be a power of two.
+///
+static constexpr auto ept_handler_table_size = 16384;
+/// Largest linear range in pages invalidated address by address before falling back to a single context invalidation.
+///
+static constexpr auto flush_max_pages   = 16;
+/// Handle cached CPUID leaves and ping VMCALL in the assembly exit stub.
+///
+static constexpr auto vmexit_fast_path  = true;
+/// Record root mode latency histograms of every exit reason per vcpu.
+///
+static constexpr auto exit_stats        = true;
+/// Number of records in the per processor trace ring filled by `logger::root`. Must be a power of two.
+///
+static constexpr auto trace_ring_size   = 1024;
+/// Least severe log level compiled in: 0 trace, 1 debug, 2 info, 3 warn, 4 error. Messages below it
+/// compile to nothing, the rest are filtered at runtime by `logger::enable`.
+///
+static constexpr auto log_level         = 2u;
+/// Log categories compiled in, bit per `trace::category_t`.
+///
+static constexpr auto log_categories    = 0xffu;
+/// Count acquisitions, contended acquisitions and spins of every spinlock.
+///
+static constexpr auto lock_stats        = false;
+/// Inline storage in bytes of `std::function`. Larger captures fail to compile.
+///
+static constexpr auto function_storage  = 32;
@@ -1,10 +1,58 @@
 #pragma once
 
+#include <cstdint>
+
 namespace heye
 {
 struct vcpu_t;
 
+/// Guest register state the vm exit stub saves around the exit handler, besides
+/// general purpose registers. Handler states which one it needs when the hypervisor
+/// is constructed, so the stub that saves the least is used on every exit.
+///
+enum class exit_state_t : uint32_t
+{
+    /// Nothing else. Handler must not touch any SSE register.
+    ///
+    gpr          = 0,
+    /// Volatile registers xmm0-xmm5. The rest is preserved by the calling convention,
+    /// so this is enough for any handler that doesn't access guest SSE state.
+    ///
+    sse_volatile = 1,
+    /// All xmm registers, available to the handler in `regs_t`.
+    ///
+    sse          = 2,
+    /// Full extended state (YMM/ZMM) saved with `xsave64` for handlers that use AVX.
+    ///
+    xsave        = 3
+};
+
 using setup_cb_t    = void(*)(vcpu_t*);
 using teardown_cb_t = void(*)(vcpu_t*);
 using vmexit_cb_t   = bool(*)(vcpu_t*);
+
+/// Guest state the exit handler needs saved. Every xmm register unless the handler
+/// specializes it, e.g. `template<> inline constexpr auto exit_state_of<handler> = exit_state_t::gpr;`.
+///
+template<vmexit_cb_t handler>
+inline constexpr auto exit_state_of = exit_state_t::sse;
+
+/// Exit handler bound to its `exit_state_of` at compile time, so the stub can't save
+/// less than the handler needs.
+///
+struct exit_callback_t
+{
+    template<vmexit_cb_t handler>
+    static consteval exit_callback_t bind()
+    {
+        static_assert(handler != nullptr, "Exit handler is required");
+        return exit_callback_t(handler, exit_state_of<handler>);
+    }
+
+    vmexit_cb_t  handler;
+    exit_state_t state;
+
+private:
+    consteval exit_callback_t(vmexit_cb_t handler, exit_state_t state) : handler(handler), state(state) {}
+};
 };
@@ -0,0 +1,18 @@
+#include "heye/hv/context.hpp"
+
+#include "heye/shared/cpu.hpp"
+
+namespace heye
+{
+void exit_context_t::flush(const cpu::regs_t& regs)
+{
+    if (dirty & guest_rip)
+        write<vmx::vmcs::guest_rip>(regs.rip);
+    if (dirty & guest_rsp)
+        write<vmx::vmcs::guest_rsp>(regs.rsp);
+    if (dirty & guest_rflags)
+        write<vmx::vmcs::guest_rflags>(regs.rflags);
+
+    invalidate();
+}
+};
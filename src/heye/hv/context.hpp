@@ -0,0 +1,70 @@
+#pragma once
+#include "heye/arch/arch.hpp"
+
+#include <cstdint>
+
+namespace heye
+{
+namespace cpu
+{
+struct regs_t;
+};
+
+/// VM exit information of the current exit. Every field is read with `vmread` at most
+/// once per exit. Guest registers saved by the vm exit stub (`regs_t::rip`, `rsp` and
+/// `rflags`) that the handler modifies are written back once, right before vm entry.
+///
+struct exit_context_t
+{
+    /// Guest fields written back by `flush`.
+    ///
+    enum guest_field_t : uint32_t
+    {
+        guest_rip    = 1 << 0,
+        guest_rsp    = 1 << 1,
+        guest_rflags = 1 << 2,
+    };
+
+    exit_context_t() : valid(0), dirty(0) {}
+
+    uint64_t reason()                 { return cached<vmx::vmcs::vm_exit_reason,          0>(); }
+    uint64_t qualification()          { return cached<vmx::vmcs::exit_qualification,      1>(); }
+    uint64_t instruction_len()        { return cached<vmx::vmcs::vm_exit_instruction_len, 2>(); }
+    uint64_t interrupt_info()         { return cached<vmx::vmcs::vm_exit_intr_info,       3>(); }
+    uint64_t interrupt_error()        { return cached<vmx::vmcs::vm_exit_intr_error_code, 4>(); }
+    uint64_t guest_physical_address() { return cached<vmx::vmcs::guest_physical_address,  5>(); }
+    uint64_t guest_linear_address()   { return cached<vmx::vmcs::guest_linear_address,    6>(); }
+
+    /// Mark guest register in `regs_t` as modified by the handler.
+    ///
+    void modify(guest_field_t field) { dirty |= field; }
+
+    /// Write modified guest registers to vmcs and forget cached fields.
+    /// Called by the vcpu right before vm entry.
+    ///
+    void flush(const cpu::regs_t& regs);
+
+    /// Forget cached fields and pending writes.
+    ///
+    void invalidate() { valid = 0; dirty = 0; }
+
+private:
+    static constexpr auto fields = 7;
+
+    template<vmx::vmcs field, uint32_t slot>
+    uint64_t cached()
+    {
+        static_assert(slot < fields);
+        if ((valid & (1 << slot)) == 0)
+        {
+            values[slot] = read<field>();
+            valid |= 1 << slot;
+        }
+        return values[slot];
+    }
+
+    uint64_t values[fields];
+    uint32_t valid;
+    uint32_t dirty;
+};
+};
@@ -0,0 +1,247 @@
+#include "heye/hv/dispatch.hpp"
+#include "heye/hv/hypervisor.hpp"
+#include "heye/hv/vmexit.hpp"
+#include "heye/hv/vmx.hpp"
+
+#include "heye/shared/cpu.hpp"
+#include "heye/arch/arch.hpp"
+
+namespace heye
+{
+/// VM-execution control that makes the exit reason happen.
+///
+struct exit_control_t
+{
+    vmx::exit_reason reason;
+    uint64_t         pin;
+    uint64_t         primary;
+    uint64_t         secondary;
+};
+
+static constexpr exit_control_t exit_controls[] =
+{
+    { vmx::exit_reason::external_interrupt,  1ull << 0, 0,                           0          },
+    { vmx::exit_reason::hlt,                 0,         1ull << 7,                   0          },
+    { vmx::exit_reason::invlpg,              0,         1ull << 9,                   0          },
+    { vmx::exit_reason::mwait_instruction,   0,         1ull << 10,                  0          },
+    { vmx::exit_reason::rdpmc,               0,         1ull << 11,                  0          },
+    { vmx::exit_reason::rdtsc,               0,         1ull << 12,                  0          },
+    { vmx::exit_reason::cr_access,           0,         (1ull << 15) | (1ull << 16), 0          },
+    { vmx::exit_reason::dr_access,           0,         1ull << 23,                  0          },
+    { vmx::exit_reason::io_instruction,      0,         1ull << 25,                  0          },
+    { vmx::exit_reason::monitor_instruction, 0,         1ull << 29,                  0          },
+    { vmx::exit_reason::pause_instruction,   0,         1ull << 30,                  0          },
+    { vmx::exit_reason::access_gdtr_or_idtr, 0,         0,                           1ull << 2  },
+    { vmx::exit_reason::access_ldtr_or_tr,   0,         0,                           1ull << 2  },
+    { vmx::exit_reason::wbinvd,              0,         0,                           1ull << 6  },
+    { vmx::exit_reason::rdrand,              0,         0,                           1ull << 11 },
+    { vmx::exit_reason::rdseed,              0,         0,                           1ull << 16 },
+};
+
+exit_table_t::exit_table_t(hv_t* hv) : hv(hv), exceptions(0)
+{
+    for (size_t reason = 0; reason < reasons; reason++)
+    {
+        handlers  [reason] = vmexit::default_handler(static_cast<vmx::exit_reason>(reason));
+        registered[reason] = false;
+    }
+
+    msrs  = new vmx::msr_bitmap_t;
+    ports = new vmx::io_bitmap_t;
+    __stosb(reinterpret_cast<unsigned char*>(msrs),  0, sizeof(vmx::msr_bitmap_t));
+    __stosb(reinterpret_cast<unsigned char*>(ports), 0, sizeof(vmx::io_bitmap_t));
+}
+
+exit_table_t::~exit_table_t()
+{
+    delete msrs;
+    delete ports;
+}
+
+exit_handler_t exit_table_t::set(vmx::exit_reason reason, exit_handler_t handler)
+{
+    const auto index = static_cast<size_t>(reason);
+    if (index >= reasons || handler == nullptr)
+        return nullptr;
+
+    const auto previous = handlers[index];
+    handlers  [index] = handler;
+    registered[index] = true;
+    configure(reason, true);
+    update();
+    return previous;
+}
+
+void exit_table_t::reset(vmx::exit_reason reason)
+{
+    const auto index = static_cast<size_t>(reason);
+    if (index >= reasons)
+        return;
+
+    handlers  [index] = vmexit::default_handler(reason);
+    registered[index] = false;
+    configure(reason, false);
+    update();
+}
+
+exit_handler_t exit_table_t::get(vmx::exit_reason reason) const
+{
+    const auto index = static_cast<size_t>(reason);
+    return index < reasons ? handlers[index] : nullptr;
+}
+
+bool exit_table_t::is_registered(vmx::exit_reason reason) const
+{
+    const auto index = static_cast<size_t>(reason);
+    return index < reasons && registered[index];
+}
+
+bool exit_table_t::dispatch(vcpu_t* vcpu) const
+{
+    const auto index = static_cast<size_t>(vcpu->exit_reason());
+    if (index >= reasons)
+    {
+        __debugbreak();
+        return false;
+    }
+    return handlers[index](vcpu);
+}
+
+void exit_table_t::intercept_msr(uint32_t id, bool read, bool write)
+{
+    uint8_t* read_bits{};
+    uint8_t* write_bits{};
+    uint32_t bit{};
+
+    if (id <= vmx::msr_bitmap_t::low_max)
+    {
+        read_bits  = msrs->read_low;
+        write_bits = msrs->write_low;
+        bit        = id;
+    }
+    else if (id >= vmx::msr_bitmap_t::high_min && id <= vmx::msr_bitmap_t::high_max)
+    {
+        read_bits  = msrs->read_high;
+        write_bits = msrs->write_high;
+        bit        = id - vmx::msr_bitmap_t::high_min;
+    }
+    else
+    {
+        // Msrs outside of the bitmap always cause vm exit.
+        //
+        return;
+    }
+
+    const auto mask = static_cast<uint8_t>(1 << (bit % 8));
+    read_bits [bit / 8] = read  ? read_bits [bit / 8] | mask : read_bits [bit / 8] & ~mask;
+    write_bits[bit / 8] = write ? write_bits[bit / 8] | mask : write_bits[bit / 8] & ~mask;
+}
+
+void exit_table_t::intercept_io(uint16_t port, bool enable)
+{
+    auto bits = port <= vmx::io_bitmap_t::a_max ? ports->io_a : ports->io_b;
+    const auto bit  = port & vmx::io_bitmap_t::a_max;
+    const auto mask = static_cast<uint8_t>(1 << (bit % 8));
+    bits[bit / 8] = enable ? bits[bit / 8] | mask : bits[bit / 8] & ~mask;
+}
+
+void exit_table_t::intercept_exception(uint32_t vector, bool enable)
+{
+    if (vector >= 32)
+        return;
+
+    if (enable)
+        _InterlockedOr(&exceptions, 1 << vector);
+    else
+        _InterlockedAnd(&exceptions, ~(1 << vector));
+    update();
+}
+
+uint64_t exit_table_t::pin_controls() const
+{
+    uint64_t controls{};
+    for (const auto& control : exit_controls)
+    {
+        if (is_registered(control.reason))
+            controls |= control.pin;
+    }
+    return controls;
+}
+
+uint64_t exit_table_t::primary_controls() const
+{
+    uint64_t controls{};
+    for (const auto& control : exit_controls)
+    {
+        if (is_registered(control.reason))
+            controls |= control.primary;
+    }
+    return controls;
+}
+
+uint64_t exit_table_t::secondary_controls() const
+{
+    uint64_t controls{};
+    for (const auto& control : exit_controls)
+    {
+        if (is_registered(control.reason))
+            controls |= control.secondary;
+    }
+    return controls;
+}
+
+uint64_t exit_table_t::cr_mask() const
+{
+    return is_registered(vmx::exit_reason::cr_access) ? ~0ull : 0;
+}
+
+uint64_t exit_table_t::msr_bitmap() const
+{
+    return pa_from_va(msrs);
+}
+
+uint64_t exit_table_t::io_bitmap_a() const
+{
+    return pa_from_va(ports->io_a);
+}
+
+uint64_t exit_table_t::io_bitmap_b() const
+{
+    return pa_from_va(ports->io_b);
+}
+
+void exit_table_t::configure(vmx::exit_reason reason, bool enable)
+{
+    const auto value = static_cast<unsigned char>(enable ? 0xff : 0);
+    switch (reason)
+    {
+    case vmx::exit_reason::msr_read:
+        __stosb(msrs->read_low,  value, sizeof(msrs->read_low));
+        __stosb(msrs->read_high, value, sizeof(msrs->read_high));
+        break;
+    case vmx::exit_reason::msr_write:
+        __stosb(msrs->write_low,  value, sizeof(msrs->write_low));
+        __stosb(msrs->write_high, value, sizeof(msrs->write_high));
+        break;
+    case vmx::exit_reason::io_instruction:
+        __stosb(ports->io_a, value, sizeof(ports->io_a));
+        __stosb(ports->io_b, value, sizeof(ports->io_b));
+        break;
+    default:
+        break;
+    }
+}
+
+void exit_table_t::update()
+{
+    // Controls of stopped vcpus are written on the next start.
+    //
+    if (!hv->is_running())
+        return;
+
+    cpu::for_each([](uint64_t)
+    {
+        vmx::vmcall(vmcall_reason::controls);
+    });
+}
+};
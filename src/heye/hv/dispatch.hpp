@@ -0,0 +1,104 @@
+#pragma once
+#include "callbacks.hpp"
+
+#include "heye/arch/vmx.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace heye
+{
+struct hv_t;
+
+/// Handler of a single exit reason. Returns `true` to leave vmx operation.
+///
+using exit_handler_t = bool(*)(vcpu_t*);
+
+/// Exit handlers indexed by exit reason. Registering a handler enables the VM-execution
+/// controls its exit needs, so exit reasons nobody handles never cause vm exits.
+/// Registering MSR or IO handlers sets the whole read, write or port bitmap and CR access
+/// handlers own all bits of CR0 and CR4, so every access reaches the handler. Handlers of
+/// CR0 and CR4 writes update the read shadows themselves. `intercept_msr` and `intercept_io`
+/// narrow the bitmaps afterwards, `reset` clears them again. CR3 target values and the CR8
+/// controls aren't managed by the table.
+///
+struct exit_table_t
+{
+    static constexpr auto reasons = static_cast<size_t>(vmx::exit_reason::max);
+
+    /// Exiting controls owned by the table.
+    ///
+    static constexpr uint64_t pin_mask       = 1ull << 0;
+    static constexpr uint64_t primary_mask   = (1ull << 7) | (1ull << 9) | (1ull << 10) | (1ull << 11) | (1ull << 12)
+                                             | (1ull << 15) | (1ull << 16) | (1ull << 23) | (1ull << 25) | (1ull << 29)
+                                             | (1ull << 30);
+    static constexpr uint64_t secondary_mask = (1ull << 2) | (1ull << 6) | (1ull << 11) | (1ull << 16);
+
+    exit_table_t (hv_t* hv);
+    ~exit_table_t();
+
+    /// Register handler of the exit reason and enable its exiting controls on every vcpu.
+    /// Returns previous handler, so the new one can chain to it. Must be called at passive level.
+    ///
+    exit_handler_t set(vmx::exit_reason reason, exit_handler_t handler);
+
+    /// Restore default handler of the exit reason and disable its exiting controls.
+    ///
+    void reset(vmx::exit_reason reason);
+
+    /// Get handler of the exit reason.
+    ///
+    exit_handler_t get(vmx::exit_reason reason) const;
+
+    /// Check if the user registered a handler for the exit reason.
+    ///
+    bool is_registered(vmx::exit_reason reason) const;
+
+    /// Call handler of the current exit reason.
+    ///
+    bool dispatch(vcpu_t* vcpu) const;
+
+    /// Set MSR bitmap bits of the msr. Takes effect immediately.
+    ///
+    void intercept_msr(uint32_t id, bool read, bool write);
+
+    /// Set IO bitmap bit of the port. Takes effect immediately.
+    ///
+    void intercept_io(uint16_t port, bool enable);
+
+    /// Set exception bitmap bit of the vector.
+    ///
+    void intercept_exception(uint32_t vector, bool enable);
+
+    /// Exiting controls required by the registered handlers.
+    ///
+    uint64_t pin_controls()       const;
+    uint64_t primary_controls()   const;
+    uint64_t secondary_controls() const;
+
+    /// Guest/host mask of CR0 and CR4.
+    ///
+    uint64_t cr_mask() const;
+
+    uint32_t exception_bitmap() const { return static_cast<uint32_t>(exceptions); }
+    uint64_t msr_bitmap()       const;
+    uint64_t io_bitmap_a()      const;
+    uint64_t io_bitmap_b()      const;
+
+private:
+    /// Update controls of every running vcpu.
+    ///
+    void update();
+
+    /// Set or clear bitmaps read by the exit reason.
+    ///
+    void configure(vmx::exit_reason reason, bool enable);
+
+    hv_t*              hv;
+    exit_handler_t     handlers  [reasons];
+    bool               registered[reasons];
+    vmx::msr_bitmap_t* msrs;
+    vmx::io_bitmap_t*  ports;
+    volatile long      exceptions;
+};
+};
@@ -1,62 +1,814 @@
 #include "heye/hv/ept.hpp"
 #include "heye/arch/arch.hpp"
 #include "heye/shared/trace.hpp"
+#include "heye/shared/cpu.hpp"
 
 namespace heye
 {
-ept_t::ept_t()
+static uint64_t pml4_index(uint64_t pa) { return (pa >> 39) & 0x1ff; }
+static uint64_t pdpt_index(uint64_t pa) { return (pa >> 30) & 0x1ff; }
+static uint64_t pd_index  (uint64_t pa) { return (pa >> 21) & 0x1ff; }
+static uint64_t pt_index  (uint64_t pa) { return (pa >> 12) & 0x1ff; }
+
+/// Entry is present if any of read, write or execute bits is set.
+///
+static bool is_present(uint64_t flags) { return (flags & 7) != 0; }
+
+/// Large page bit of PDPT and page directory entries.
+///
+static constexpr uint64_t large_page_bit = 1ull << 7;
+
+/// Ignored bit of non-leaf entries used to mark tables owned by the root view.
+/// Such tables are copied before the view modifies them.
+///
+static constexpr uint64_t shared_table   = 1ull << 11;
+
+/// Physical address of the table referenced by non-leaf entry.
+///
+static constexpr uint64_t table_mask     = 0x0000fffffffff000;
+
+/// Non-leaf entry that references next level table shared with the root view.
+///
+static bool is_shared(uint64_t flags) { return is_present(flags) && (flags & large_page_bit) == 0 && (flags & shared_table) != 0; }
+
+/// Atomically replace EPT entry. Fails if somebody else changed it first.
+///
+static bool exchange_entry(uint64_t* entry, uint64_t value, uint64_t expected)
+{
+    return _InterlockedCompareExchange64(
+        reinterpret_cast<volatile long long*>(entry),
+        static_cast<long long>(value),
+        static_cast<long long>(expected)) == static_cast<long long>(expected);
+}
+
+/// Non-leaf entry that references next level table.
+///
+template<typename T>
+static T make_table_entry(uint64_t pa)
+{
+    T entry{};
+    entry.read    = true;
+    entry.write   = true;
+    entry.execute = true;
+    entry.pfn     = pfn(pa);
+    return entry;
+}
+
+static pdpt_1gb_t make_1gb_page(uint64_t pa, memory_type_t type)
+{
+    pdpt_1gb_t entry{};
+    entry.read        = true;
+    entry.write       = true;
+    entry.execute     = true;
+    entry.large_page  = true;
+    entry.memory_type = type;
+    entry.pfn         = pa / 1_gb;
+    return entry;
+}
+
+void frame_bitmap_t::set(uint64_t pa, uint64_t size)
+{
+    const auto end   = base + frames * page_size;
+    const auto start = pa > base ? pa : base;
+    const auto stop  = pa + size < end ? pa + size : end;
+    if (start >= stop)
+        return;
+
+    auto       frame = (start - base) / page_size;
+    const auto last  = (stop  - base + page_size - 1) / page_size;
+    // Large pages cover whole words, so fill them at once.
+    //
+    for (; frame < last && frame % 64 != 0; frame++)
+        bits[frame / 64] |= 1ull << (frame % 64);
+
+    for (; frame + 64 <= last; frame += 64)
+        bits[frame / 64] = ~0ull;
+
+    for (; frame < last; frame++)
+        bits[frame / 64] |= 1ull << (frame % 64);
+}
+
+bool frame_bitmap_t::test(uint64_t pa) const
+{
+    if (pa < base || pa >= base + frames * page_size)
+        return false;
+
+    const auto frame = (pa - base) / page_size;
+    return (bits[frame / 64] & (1ull << (frame % 64))) != 0;
+}
+
+ept_t::ept_t(table_pool_t* pool) : page_table(nullptr), pool(pool), root(this), views(0), mtrr(nullptr)
 {
     // Allocate page table.
     //
-    page_table =  new page_table_t;
+    page_table = new page_table_t;
+    mtrr       = new mtrr_descriptor;
+    if (page_table == nullptr || mtrr == nullptr)
+    {
+        logger::error<logger::category_t::ept>("Failed to allocate EPT page table");
+        destroy();
+        return;
+    }
 
-    const auto mtrr = mtrr_descriptor();
-    const auto cap  = read<msr::vmx_ept_vpid_cap>();
+    const auto cap = read<msr::vmx_ept_vpid_cap>();
+    use_1gb_pages        = ept_use_1gb_pages && cap.pde_1g;
+    max_physical_address = 1ull << read<cpuid::address_sizes>().physical_address_bits;
     // Setup EPT pointer.
     //
     ept.access_flags     = cap.ept_access_dirty;
     ept.page_walk_length = page_walk_4;
     ept.memory_type      = cap.memory_type_wb ? memory_type_t::write_back : memory_type_t::uncachable;
     ept.pml4_address     = pfn(pa_from_va(page_table->pml4));
-    // Setup PML4 entries.
+    // Map every gigabyte touched by physical memory or MMIO range. Gigabytes with uniform memory
+    // type are mapped with 1GB pages, the rest fall back to 2MB pages.
     //
-    page_table->pml4[0].read    = true;
-    page_table->pml4[0].write   = true;
-    page_table->pml4[0].execute = true;
-    page_table->pml4[0].pfn     = pfn(pa_from_va(page_table->pdpt));
-    // Setup PDPT entries.
-    //
-    for (int i = 0; i < std::countof(page_table->pdpt); i++)
+    for (const auto& range : memory_map_t())
     {
-        page_table->pdpt[i].read    = true;
-        page_table->pdpt[i].write   = true;
-        page_table->pdpt[i].execute = true;
-        page_table->pdpt[i].pfn     = pfn(pa_from_va(&page_table->pd[i][0]));
+        for (auto pa = range.base & ~(1_gb - 1); pa < range.base + range.size; pa += 1_gb)
+        {
+            if (!build(pa))
+            {
+                logger::error<logger::category_t::ept>("Failed to allocate EPT tables for 0x%llx", pa);
+                destroy();
+                return;
+            }
+        }
     }
-    // Setup PD and PTE entries.
+    populate();
+    logger::info<logger::category_t::ept>("EPT mapped %ld gigabytes, %ld with 1GB pages", mapped(), large_pages());
+}
+
+ept_t::ept_t(ept_t* source) : page_table(nullptr), pool(source->pool), root(source->root), views(0), mtrr(nullptr)
+{
+    page_table = new page_table_t;
+    if (page_table == nullptr)
+    {
+        logger::error<logger::category_t::ept>("Failed to allocate EPT view page table");
+        return;
+    }
+
+    mtrr                 = root->mtrr;
+    use_1gb_pages        = root->use_1gb_pages;
+    max_physical_address = root->max_physical_address;
+
+    ept              = root->ept;
+    ept.pml4_address = pfn(pa_from_va(page_table->pml4));
+    // Only PML4 is private, everything below it is shared with the root view
+    // until this view modifies it.
     //
-    for (int i = 0; i < std::countof(page_table->pd); i++)
+    for (uint64_t i = 0; i < pt_enties; i++)
     {
-        for (int j = 0; j < std::countof(page_table->pd); j++)
-        {
-            const auto pfn                   = (i * 512) + j;
-            page_table->pd[i][j].read        = true;
-            page_table->pd[i][j].write       = true;
-            page_table->pd[i][j].execute     = true;
-            page_table->pd[i][j].large_page  = true;
-            page_table->pd[i][j].pfn         = pfn;
-            page_table->pd[i][j].memory_type = mtrr.get_type_or(pfn * 2_mb, memory_type_t::write_back);
-        }
+        const auto entry = root->page_table->pml4[i].flags;
+        if (is_present(entry))
+            page_table->pml4[i].flags = entry | shared_table;
     }
+    _InterlockedIncrement(&root->views);
 }
 
 ept_t::~ept_t()
 {
+    destroy();
+}
+
+void ept_t::destroy()
+{
+    if (page_table == nullptr)
+    {
+        delete mtrr;
+        mtrr = nullptr;
+        return;
+    }
+
+    if (is_view())
+    {
+        for (const auto& entry : page_table->pml4)
+        {
+            if (is_present(entry.flags) && !is_shared(entry.flags))
+                release(entry.flags & table_mask, level_t::pdpt);
+        }
+        delete page_table;
+        page_table = nullptr;
+        _InterlockedDecrement(&root->views);
+        return;
+    }
+
+    for (auto table : page_table->pdpt)
+    {
+        if (table != nullptr)
+        {
+            for (auto pd : table->pd)
+            {
+                if (pd != nullptr)
+                {
+                    delete[] pd;
+                }
+            }
+            delete table;
+        }
+    }
     delete page_table;
+    delete mtrr;
+    page_table = nullptr;
+    mtrr       = nullptr;
 }
 
 eptp_t ept_t::ept_pointer() const
 {
     return ept;
 }
+
+size_t ept_t::mapped() const
+{
+    size_t count{};
+    for (uint64_t pa = 0; pa < max_physical_address; pa += 1_gb)
+    {
+        const auto entry = pdpt(pa);
+        if (entry == nullptr)
+        {
+            // Skip the whole 512GB region.
+            //
+            pa += 511_gb;
+            continue;
+        }
+        if (is_present(entry->flags))
+            count++;
+    }
+    return count;
+}
+
+size_t ept_t::large_pages() const
+{
+    size_t count{};
+    for (uint64_t pa = 0; pa < max_physical_address; pa += 1_gb)
+    {
+        const auto entry = pdpt(pa);
+        if (entry == nullptr)
+        {
+            pa += 511_gb;
+            continue;
+        }
+        if (is_present(entry->flags) && entry->large_page)
+            count++;
+    }
+    return count;
+}
+
+bool ept_t::map(uint64_t pa)
+{
+    if (pa >= max_physical_address)
+        return false;
+
+    if (is_view())
+    {
+        // Gigabytes are always mapped in the root view, so other views can keep sharing them.
+        //
+        if (!root->map(pa))
+            return false;
+
+        auto pml4 = &page_table->pml4[pml4_index(pa)];
+        const auto shared = root->page_table->pml4[pml4_index(pa)].flags | shared_table;
+        if (exchange_entry(&pml4->flags, shared, 0) || is_shared(pml4->flags))
+            return true;
+        // View copied the PDPT of the region before, so the new gigabyte is only
+        // in the root one. Its entry is copied, the tables below stay shared.
+        //
+        auto entry = pdpt(pa);
+        const auto expected = entry->flags;
+        if (is_present(expected))
+            return true;
+
+        auto value = root->pdpt(pa)->flags;
+        if ((value & large_page_bit) == 0)
+            value |= shared_table;
+        exchange_entry(&entry->flags, value, expected);
+        return true;
+    }
+
+    auto pml4 = &page_table->pml4[pml4_index(pa)];
+    if (!is_present(pml4->flags))
+    {
+        auto table = pool->allocate();
+        if (table == nullptr)
+            return false;
+
+        if (!exchange_entry(&pml4->flags, make_table_entry<pml4_t>(pool->pa(table)).flags, 0))
+            pool->free(table);
+    }
+
+    auto entry = pdpt(pa);
+    const auto expected = entry->flags;
+    if (is_present(expected))
+        return true;
+
+    memory_type_t type{};
+    if (use_1gb_pages && is_uniform(pa, type))
+    {
+        exchange_entry(&entry->flags, make_1gb_page(pa, type).flags, expected);
+        return true;
+    }
+
+    auto pd = static_cast<pd_2mb_t*>(pool->allocate());
+    if (pd == nullptr)
+        return false;
+
+    fill(pd, pa);
+    if (!exchange_entry(&entry->flags, make_table_entry<pdpt_t>(pool->pa(pd)).flags, expected))
+        pool->free(pd);
+    return true;
+}
+
+pte_t* ept_t::split(uint64_t pa)
+{
+    // Loop until the 4KB entry is reached, since other processors might split
+    // or modify the same entries concurrently.
+    //
+    while (true)
+    {
+        if (is_view() && !unshare(pa))
+            return nullptr;
+
+        auto entry = pdpt(pa);
+        if (entry == nullptr || !is_present(entry->flags))
+            return nullptr;
+
+        if (entry->large_page)
+        {
+            if (!split_1gb(entry))
+                return nullptr;
+            continue;
+        }
+
+        auto large = &pd(pa)[pd_index(pa)];
+        if (large->large_page)
+        {
+            if (!split_2mb(large))
+                return nullptr;
+            continue;
+        }
+        return pte(pa);
+    }
+}
+
+bool ept_t::merge(uint64_t pa)
+{
+    // Views might still reference the table.
+    //
+    if (views != 0)
+        return false;
+
+    auto pd = this->pd(pa);
+    if (pd == nullptr)
+        return false;
+
+    auto entry = reinterpret_cast<pd_t*>(&pd[pd_index(pa)]);
+    const auto expected = entry->flags;
+    if (reinterpret_cast<pd_2mb_t*>(entry)->large_page || !pool->owns(entry->pfn << page_shift))
+        return false;
+
+    // Views never modify tables of the root view.
+    //
+    if (is_view() && (is_shared(page_table->pml4[pml4_index(pa)].flags) || is_shared(pdpt(pa)->flags) || is_shared(expected)))
+        return false;
+
+    const auto pt = static_cast<pte_t*>(pool->va(entry->pfn << page_shift));
+    // Entries must map contiguous, 2MB aligned memory with the same attributes.
+    // Accessed and dirty flags are accumulated into the large page.
+    //
+    pte_t ignored{};
+    ignored.accessed = true;
+    ignored.dirty    = true;
+    ignored.pfn      = (1ull << 36) - 1;
+
+    const auto first = pt[0];
+    if (first.pfn % pt_enties != 0)
+        return false;
+
+    auto scan = [&](uint64_t& flags)
+    {
+        for (uint64_t i = 0; i < pt_enties; i++)
+        {
+            const auto current = pt[i];
+            if (current.pfn != first.pfn + i || (current.flags & ~ignored.flags) != (first.flags & ~ignored.flags))
+                return false;
+            flags |= current.flags & (ignored.flags & ~table_mask);
+        }
+        return true;
+    };
+
+    uint64_t flags{};
+    if (!scan(flags))
+        return false;
+
+    pd_2mb_t large{};
+    large.read             = first.read;
+    large.write            = first.write;
+    large.execute          = first.execute;
+    large.memory_type      = first.memory_type;
+    large.ignore_pat       = first.ignore_pat;
+    large.execute_usermode = first.execute_usermode;
+    large.suppress_ve      = first.suppress_ve;
+    large.large_page       = true;
+    large.pfn              = first.pfn / pt_enties;
+    large.flags           |= flags;
+
+    if (!exchange_entry(&entry->flags, large.flags, expected))
+        return false;
+
+    // Processors set flags and handlers in vmx root remap entries of the table until it's
+    // out of their caches. Flags set since the scan are carried over, a remapped entry
+    // puts the table back.
+    //
+    uint64_t late{};
+    if (!scan(late))
+    {
+        auto current = entry->flags;
+        while (!exchange_entry(&entry->flags, expected, current))
+            current = entry->flags;
+        // Flags set through the large page meanwhile apply to all of its entries.
+        //
+        const auto lost = current & (ignored.flags & ~table_mask);
+        for (uint64_t i = 0; lost != 0 && i < pt_enties; i++)
+            _InterlockedOr64(reinterpret_cast<volatile long long*>(&pt[i].flags), static_cast<long long>(lost));
+        return false;
+    }
+
+    if ((late & ~flags) != 0)
+        _InterlockedOr64(reinterpret_cast<volatile long long*>(&entry->flags), static_cast<long long>(late));
+    // Other processors might still walk the table, so it can't be reused until invalidation.
+    //
+    pool->retire(pt);
+    return true;
+}
+
+pte_t* ept_t::pte(uint64_t pa) const
+{
+    auto pd = this->pd(pa);
+    if (pd == nullptr || !is_present(pd[pd_index(pa)].flags) || pd[pd_index(pa)].large_page)
+        return nullptr;
+
+    const auto entry = reinterpret_cast<const pd_t*>(&pd[pd_index(pa)]);
+    return &static_cast<pte_t*>(table(entry->pfn << page_shift, pa, level_t::pt))[pt_index(pa)];
+}
+
+size_t ept_t::harvest(frame_bitmap_t& bitmap, access_bit_t bit)
+{
+    if (!tracks_access())
+        return 0;
+
+    const auto mask = static_cast<uint64_t>(bit);
+    const auto end  = bitmap.base + bitmap.frames * page_size;
+
+    size_t count{};
+    // Flag is tested before the atomic clear to avoid dirtying cache lines of untouched entries.
+    //
+    auto collect = [&](uint64_t* entry, uint64_t pa, uint64_t size)
+    {
+        if ((*entry & mask) != 0 && (_InterlockedAnd64(reinterpret_cast<volatile long long*>(entry), ~mask) & mask) != 0)
+        {
+            bitmap.set(pa, size);
+            count++;
+        }
+    };
+
+    for (auto pa = bitmap.base & ~(1_gb - 1); pa < end; pa += 1_gb)
+    {
+        auto entry = pdpt(pa);
+        if (entry == nullptr)
+        {
+            // Skip the rest of unmapped 512GB region.
+            //
+            pa = (pa & ~(512_gb - 1)) + 511_gb;
+            continue;
+        }
+
+        if (!is_present(entry->flags))
+            continue;
+
+        if (entry->large_page)
+        {
+            collect(&entry->flags, pa, 1_gb);
+            continue;
+        }
+
+        auto pd = this->pd(pa);
+        for (uint64_t i = 0; i < pt_enties; i++)
+        {
+            const auto pa_2mb = pa + i * 2_mb;
+            if (pa_2mb + 2_mb <= bitmap.base || pa_2mb >= end || !is_present(pd[i].flags))
+                continue;
+
+            if (pd[i].large_page)
+            {
+                collect(&pd[i].flags, pa_2mb, 2_mb);
+                continue;
+            }
+
+            auto pt = static_cast<pte_t*>(table(reinterpret_cast<pd_t*>(&pd[i])->pfn << page_shift, pa_2mb, level_t::pt));
+            for (uint64_t j = 0; j < pt_enties; j++)
+            {
+                const auto pa_4kb = pa_2mb + j * page_size;
+                if (pa_4kb < bitmap.base || pa_4kb >= end || !is_present(pt[j].flags))
+                    continue;
+
+                collect(&pt[j].flags, pa_4kb, page_size);
+            }
+        }
+    }
+    return count;
+}
+
+uint64_t ept_t::clear(uint64_t pa, access_bit_t bit)
+{
+    const auto mask = static_cast<uint64_t>(bit);
+
+    auto clear_entry = [mask](uint64_t* entry)
+    {
+        if ((*entry & mask) != 0)
+            _InterlockedAnd64(reinterpret_cast<volatile long long*>(entry), ~mask);
+    };
+
+    auto entry = pdpt(pa);
+    if (entry == nullptr || !is_present(entry->flags))
+        return 0;
+
+    if (entry->large_page)
+    {
+        clear_entry(&entry->flags);
+        return 1_gb;
+    }
+
+    auto large = &pd(pa)[pd_index(pa)];
+    if (!is_present(large->flags))
+        return 0;
+
+    if (large->large_page)
+    {
+        clear_entry(&large->flags);
+        return 2_mb;
+    }
+
+    clear_entry(&pte(pa)->flags);
+    return page_size;
+}
+
+void ept_t::invalidate() const
+{
+    vmx::invept(vmx::invept_t::single_context, ept.flags);
+}
+
+bool ept_t::build(uint64_t pa)
+{
+    auto& table = page_table->pdpt[pml4_index(pa)];
+    if (table == nullptr)
+    {
+        table = new pdpt_table_t;
+        if (table == nullptr)
+            return false;
+
+        page_table->pml4[pml4_index(pa)] = make_table_entry<pml4_t>(pa_from_va(table->pdpt));
+    }
+
+    const auto index = pdpt_index(pa);
+    if (is_present(table->pdpt[index].flags))
+        return true;
+
+    memory_type_t type{};
+    if (use_1gb_pages && is_uniform(pa, type))
+    {
+        table->pdpt_1gb[index] = make_1gb_page(pa, type);
+    }
+    else
+    {
+        // Page directory is filled by `populate`.
+        //
+        auto pd = new pd_2mb_t[pt_enties];
+        if (pd == nullptr)
+            return false;
+
+        table->pd  [index] = pd;
+        table->pdpt[index] = make_table_entry<pdpt_t>(pa_from_va(pd));
+    }
+    return true;
+}
+
+bool ept_t::is_uniform(uint64_t pa, memory_type_t& type) const
+{
+    // 1GB page can only be used if the whole gigabyte has the same memory type.
+    //
+    const auto range = mtrr->get_range_type_or(pa & ~(1_gb - 1), 1_gb, mtrr->default_type());
+    type = range.type;
+    return range.uniform;
+}
+
+void ept_t::populate()
+{
+    // Every page directory entry needs its own MTRR lookup, so processors fill
+    // interleaved PDPT slots in parallel. Tables are already allocated, since
+    // allocation isn't possible at IPI level.
+    //
+    const auto processors = cpu::count();
+    cpu::for_each([this, processors](uint64_t cpu_number)
+    {
+        for (uint64_t i = 0; i < pt_enties; i++)
+        {
+            const auto table = page_table->pdpt[i];
+            if (table == nullptr)
+                continue;
+
+            for (uint64_t j = 0; j < pt_enties; j++)
+            {
+                if ((i * pt_enties + j) % processors == cpu_number && table->pd[j] != nullptr)
+                    fill(table->pd[j], i * 512_gb + j * 1_gb);
+            }
+        }
+    });
+}
+
+void ept_t::fill(pd_2mb_t* pd, uint64_t pa) const
+{
+    const auto base = pa & ~(1_gb - 1);
+
+    for (uint64_t i = 0; i < pt_enties; i++)
+    {
+        pd[i].read        = true;
+        pd[i].write       = true;
+        pd[i].execute     = true;
+        pd[i].large_page  = true;
+        pd[i].pfn         = (base + i * 2_mb) / 2_mb;
+        pd[i].memory_type = mtrr->get_type_or(base + i * 2_mb, mtrr->default_type());
+    }
+}
+
+void* ept_t::table(uint64_t table_pa, uint64_t pa, level_t level) const
+{
+    if (pool->owns(table_pa))
+        return pool->va(table_pa);
+    // Tables allocated during construction are only referenced by the root view
+    // and views that share them.
+    //
+    const auto table = root->page_table->pdpt[pml4_index(pa)];
+    switch (level)
+    {
+    case level_t::pdpt:
+        return table->pdpt_1gb;
+    case level_t::pd:
+        return table->pd[pdpt_index(pa)];
+    default:
+        return nullptr;
+    }
+}
+
+pdpt_1gb_t* ept_t::pdpt(uint64_t pa) const
+{
+    const auto pml4 = page_table->pml4[pml4_index(pa)];
+    if (!is_present(pml4.flags))
+        return nullptr;
+
+    return &static_cast<pdpt_1gb_t*>(table(pml4.pfn << page_shift, pa, level_t::pdpt))[pdpt_index(pa)];
+}
+
+pd_2mb_t* ept_t::pd(uint64_t pa) const
+{
+    const auto entry = pdpt(pa);
+    if (entry == nullptr || !is_present(entry->flags) || entry->large_page)
+        return nullptr;
+
+    return static_cast<pd_2mb_t*>(table(reinterpret_cast<const pdpt_t*>(entry)->pfn << page_shift, pa, level_t::pd));
+}
+
+bool ept_t::unshare(uint64_t pa)
+{
+    if (!copy_shared(&page_table->pml4[pml4_index(pa)].flags, pa, level_t::pdpt))
+        return false;
+
+    const auto entry = pdpt(pa);
+    if (entry == nullptr || !is_present(entry->flags) || entry->large_page)
+        return true;
+
+    if (!copy_shared(&entry->flags, pa, level_t::pd))
+        return false;
+
+    const auto large = &pd(pa)[pd_index(pa)];
+    if (!is_present(large->flags) || large->large_page)
+        return true;
+
+    return copy_shared(&large->flags, pa, level_t::pt);
+}
+
+bool ept_t::copy_shared(uint64_t* entry, uint64_t pa, level_t level)
+{
+    const auto expected = *entry;
+    if (!is_shared(expected))
+        return true;
+
+    auto copy = static_cast<uint64_t*>(pool->allocate());
+    if (copy == nullptr)
+    {
+        logger::root<logger::level_t::error, logger::category_t::ept>("EPT pool exhausted");
+        return false;
+    }
+
+    // Tables referenced by the copy still belong to the root view.
+    //
+    const auto source = static_cast<const uint64_t*>(table(expected & table_mask, pa, level));
+    for (uint64_t i = 0; i < pt_enties; i++)
+    {
+        copy[i] = source[i];
+        if (level != level_t::pt && is_present(copy[i]) && (copy[i] & large_page_bit) == 0)
+            copy[i] |= shared_table;
+    }
+
+    const auto value = (expected & ~(table_mask | shared_table)) | pool->pa(copy);
+    if (!exchange_entry(entry, value, expected))
+    {
+        // Somebody else copied this table first.
+        //
+        pool->free(copy);
+    }
+    return true;
+}
+
+void ept_t::release(uint64_t table_pa, level_t level)
+{
+    auto entries = static_cast<uint64_t*>(pool->va(table_pa));
+    if (level != level_t::pt)
+    {
+        const auto next = level == level_t::pdpt ? level_t::pd : level_t::pt;
+        for (uint64_t i = 0; i < pt_enties; i++)
+        {
+            if (is_present(entries[i]) && (entries[i] & large_page_bit) == 0 && !is_shared(entries[i]))
+                release(entries[i] & table_mask, next);
+        }
+    }
+    pool->free(entries);
+}
+
+bool ept_t::split_1gb(pdpt_1gb_t* entry)
+{
+    const auto expected = *entry;
+    if (!expected.large_page)
+        return true;
+
+    auto pd = static_cast<pd_2mb_t*>(pool->allocate());
+    if (pd == nullptr)
+    {
+        logger::root<logger::level_t::error, logger::category_t::ept>("EPT pool exhausted");
+        return false;
+    }
+
+    for (uint64_t i = 0; i < pt_enties; i++)
+    {
+        pd[i].read             = expected.read;
+        pd[i].write            = expected.write;
+        pd[i].execute          = expected.execute;
+        pd[i].memory_type      = expected.memory_type;
+        pd[i].ignore_pat       = expected.ignore_pat;
+        pd[i].execute_usermode = expected.execute_usermode;
+        pd[i].suppress_ve      = expected.suppress_ve;
+        pd[i].large_page       = true;
+        pd[i].pfn              = expected.pfn * pt_enties + i;
+    }
+
+    if (!exchange_entry(&entry->flags, make_table_entry<pdpt_t>(pool->pa(pd)).flags, expected.flags))
+    {
+        // Somebody else changed this entry first.
+        //
+        pool->free(pd);
+    }
+    return true;
+}
+
+bool ept_t::split_2mb(pd_2mb_t* entry)
+{
+    const auto expected = *entry;
+    if (!expected.large_page)
+        return true;
+
+    auto pt = static_cast<pte_t*>(pool->allocate());
+    if (pt == nullptr)
+    {
+        logger::root<logger::level_t::error, logger::category_t::ept>("EPT pool exhausted");
+        return false;
+    }
+
+    for (uint64_t i = 0; i < pt_enties; i++)
+    {
+        pt[i].read             = expected.read;
+        pt[i].write            = expected.write;
+        pt[i].execute          = expected.execute;
+        pt[i].memory_type      = expected.memory_type;
+        pt[i].ignore_pat       = expected.ignore_pat;
+        pt[i].execute_usermode = expected.execute_usermode;
+        pt[i].suppress_ve      = expected.suppress_ve;
+        pt[i].pfn              = expected.pfn * pt_enties + i;
+    }
+
+    if (!exchange_entry(&entry->flags, make_table_entry<pd_t>(pool->pa(pt)).flags, expected.flags))
+    {
+        // Somebody else changed this entry first.
+        //
+        pool->free(pt);
+    }
+    return true;
+}
 }
@@ -1,4 +1,6 @@
 #pragma once
+#include "pool.hpp"
+
 #include "heye/arch/memory.hpp"
 #include "heye/arch/mtrr.hpp"
 #include "heye/arch/paging.hpp"
@@ -8,22 +10,226 @@ namespace heye
 static constexpr auto pt_enties   = 512;
 static constexpr auto page_walk_4 = 3;
 
+/// Page directory pointer table of a 512GB region allocated during construction.
+///
+struct pdpt_table_t
+{
+    union
+    {
+        pdpt_t     pdpt    [pt_enties];
+        pdpt_1gb_t pdpt_1gb[pt_enties];
+    };
+
+    /// Page directories of gigabytes with mixed memory types allocated during construction.
+    /// Entry is `nullptr` if gigabyte is not mapped, mapped with 1GB page or its page directory came from the pool.
+    ///
+    pd_2mb_t* pd[pt_enties];
+};
+static_assert(sizeof(pdpt_table_t) == 2 * page_size);
+
 struct page_table_t
 {
-    pml4_t   pml4[pt_enties];
-    pdpt_t   pdpt[pt_enties];
-    pd_2mb_t pd  [pt_enties][pt_enties];
+    pml4_t pml4[pt_enties];
+
+    /// Entry is `nullptr` if 512GB region is not mapped or its table came from the pool.
+    ///
+    pdpt_table_t* pdpt[pt_enties];
+};
+static_assert(sizeof(page_table_t) == 2 * page_size);
+
+/// Accessed and dirty flags share the same bits in every EPT leaf entry.
+///
+enum class access_bit_t : uint64_t
+{
+    accessed = 1 << 8,
+    dirty    = 1 << 9
+};
+
+/// Caller supplied bitmap of 4KB guest physical frames.
+///
+struct frame_bitmap_t
+{
+    /// Guest physical address of the first frame.
+    ///
+    uint64_t  base;
+    /// Number of frames covered by the bitmap.
+    ///
+    uint64_t  frames;
+    /// Bitmap storage of at least `(frames + 63) / 64` entries.
+    ///
+    uint64_t* bits;
+
+    /// Mark frames of the physical range. Range is clipped to the bitmap.
+    ///
+    void set(uint64_t pa, uint64_t size);
+
+    /// Check if frame of the physical address is marked.
+    ///
+    bool test(uint64_t pa) const;
 };
 
 struct ept_t final
 {
-    ept_t ();
+    /// Build root view that identity maps physical memory.
+    ///
+    ept_t (table_pool_t* pool);
+
+    /// Create view that shares every table with the root view. Tables are copied
+    /// only when the view modifies them.
+    ///
+    ept_t (ept_t* root);
+
     ~ept_t();
 
+    /// Check if construction succeeded. Invalid view must not be used.
+    ///
+    operator bool() const { return page_table != nullptr; }
+
     eptp_t ept_pointer() const;
 
+    /// Check if this view was cloned from another one.
+    ///
+    bool is_view() const { return root != this; }
+
+    /// Number of mapped gigabytes.
+    ///
+    size_t mapped() const;
+
+    /// Number of gigabytes mapped with 1GB pages.
+    ///
+    size_t large_pages() const;
+
+    /// Identity map gigabyte containing `pa` if it is not mapped yet. Used for MMIO outside of
+    /// the physical memory map. Tables are taken from the pool, so this is safe to call in vmx root.
+    ///
+    bool map(uint64_t pa);
+
+    /// Split large page containing `pa` down to 4KB pages and return its 4KB entry.
+    /// 1GB page is split into 2MB pages first. Tables shared with the root view are copied first,
+    /// so the returned entry is private to this view. Tables are taken from the pool, so this
+    /// is safe to call in vmx root. Returns `nullptr` if pool is exhausted or `pa` is not mapped.
+    ///
+    pte_t* split(uint64_t pa);
+
+    /// Coalesce 4KB table of the 2MB page containing `pa` back into large page if all
+    /// 512 entries map contiguous memory with the same attributes.
+    /// Released table is retired in the pool and reclaimed by the next `hv_t::invalidate_ept`.
+    /// Root view never merges while other views exist since they might share the table.
+    /// Table is re-checked after the swap, so accessed and dirty flags set meanwhile are kept
+    /// and an entry remapped meanwhile undoes the merge. Callers at passive level hold `hv_t::ept_lock`.
+    ///
+    bool merge(uint64_t pa);
+
+    /// Get 4KB entry of `pa`. Returns `nullptr` if `pa` is not mapped with 4KB page.
+    ///
+    pte_t* pte(uint64_t pa) const;
+
+    /// Collect and clear accessed or dirty flags of leaf entries within the bitmap range.
+    /// Large pages mark every frame they cover. Returns number of leaf entries that had the flag set.
+    /// Processors keep caching the old flags, so EPT must be invalidated on every processor afterwards.
+    ///
+    size_t harvest(frame_bitmap_t& bitmap, access_bit_t bit);
+
+    /// Clear accessed or dirty flag of the leaf entry that maps `pa`.
+    /// Returns size of the leaf page or 0 if `pa` is not mapped.
+    ///
+    uint64_t clear(uint64_t pa, access_bit_t bit);
+
+    /// Check if processor maintains accessed and dirty flags for this EPT.
+    ///
+    bool tracks_access() const { return ept.access_flags; }
+
+    /// Invalidate EPT derived translations on the current processor. Must be called in vmx root.
+    ///
+    void invalidate() const;
+
 private:
+    /// Level of the table an entry points to.
+    ///
+    enum class level_t
+    {
+        pdpt,
+        pd,
+        pt
+    };
+
+    /// Map gigabyte during construction. Page directory of a gigabyte with mixed memory
+    /// types is allocated and left empty until `populate`. Returns `false` if out of memory.
+    ///
+    bool build(uint64_t pa);
+
+    /// Free tables owned by this view. Leaves the view invalid.
+    ///
+    void destroy();
+
+    /// Fill page directories allocated by `build` on all processors.
+    ///
+    void populate();
+
+    /// Check if all 2MB pages of the gigabyte have the same memory type.
+    ///
+    bool is_uniform(uint64_t pa, memory_type_t& type) const;
+
+    /// Fill page directory with 2MB pages of the gigabyte.
+    ///
+    void fill(pd_2mb_t* pd, uint64_t pa) const;
+
+    /// Get virtual address of the table at `level` that translates `pa`.
+    /// Tables either come from the pool or were allocated during construction of the root view.
+    ///
+    void* table(uint64_t table_pa, uint64_t pa, level_t level) const;
+
+    /// Get PDPT entry of `pa`. Returns `nullptr` if 512GB region is not mapped.
+    ///
+    pdpt_1gb_t* pdpt(uint64_t pa) const;
+
+    /// Get page directory of `pa`. Returns `nullptr` if gigabyte is not mapped or mapped with 1GB page.
+    ///
+    pd_2mb_t* pd(uint64_t pa) const;
+
+    /// Copy every table on the path to `pa` that is shared with the root view.
+    /// Returns `false` if pool is exhausted.
+    ///
+    bool unshare(uint64_t pa);
+
+    /// Replace shared table referenced by the entry with a private copy.
+    ///
+    bool copy_shared(uint64_t* entry, uint64_t pa, level_t level);
+
+    /// Split 1GB page into 2MB pages. Returns `false` if pool is exhausted.
+    ///
+    bool split_1gb(pdpt_1gb_t* entry);
+
+    /// Split 2MB page into 4KB pages. Returns `false` if pool is exhausted.
+    ///
+    bool split_2mb(pd_2mb_t* entry);
+
+    /// Return private tables of the view to the pool.
+    ///
+    void release(uint64_t table_pa, level_t level);
+
     eptp_t ept{};
     page_table_t* page_table;
+    table_pool_t* pool;
+
+    /// View that owns tables allocated during construction. Points to itself for the root view.
+    ///
+    ept_t* root;
+
+    /// Number of views cloned from this one.
+    ///
+    volatile long views;
+
+    /// Memory types are kept by the root view for mapping gigabytes on demand.
+    ///
+    mtrr_descriptor* mtrr;
+
+    /// Use 1GB pages for gigabytes with uniform memory type.
+    ///
+    bool use_1gb_pages;
+
+    /// Addresses above this limit are never mapped.
+    ///
+    uint64_t max_physical_address;
 };
 };
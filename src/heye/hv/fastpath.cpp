@@ -0,0 +1,64 @@
+#include "heye/hv/fastpath.hpp"
+#include "heye/arch/arch.hpp"
+
+#include <intrin.h>
+
+namespace heye
+{
+/// Leaves whose results don't change after boot. Leaves that depend on guest
+/// state (e.g. XSAVE sizes of 0Dh follow XCR0) always go to the exit handler.
+/// OSXSAVE of leaf 1 and OSPKE of leaf 7 follow guest CR4 and are patched by the stub.
+///
+static constexpr struct
+{
+    uint32_t leaf;
+    uint32_t subleaf;
+    bool     indexed;
+    uint8_t  cr4_bit;
+    uint8_t  ecx_bit;
+} cached_leaves[] =
+{
+    { 0x00000000, 0, false,  0,  0 },
+    { 0x00000001, 0, false, 18, 27 },
+    { 0x00000007, 0, true,  22,  4 },
+    { 0x80000000, 0, false,  0,  0 },
+    { 0x80000001, 0, false,  0,  0 },
+    { 0x80000002, 0, false,  0,  0 },
+    { 0x80000003, 0, false,  0,  0 },
+    { 0x80000004, 0, false,  0,  0 },
+    { 0x80000008, 0, false,  0,  0 },
+};
+static_assert(sizeof(cached_leaves) / sizeof(cached_leaves[0]) <= exit_cache_t::max_cpuid);
+
+void exit_cache_t::fill()
+{
+    cpuid_count = 0;
+    for (const auto& cached : cached_leaves)
+    {
+        auto& entry = cpuid[cpuid_count++];
+        entry.leaf    = cached.leaf;
+        entry.subleaf = cached.subleaf;
+        entry.indexed = cached.indexed;
+        entry.cr4_bit = cached.cr4_bit;
+        entry.ecx_bit = cached.ecx_bit;
+        platform::cpuid(entry.regs, static_cast<int>(cached.leaf), static_cast<int>(cached.subleaf));
+    }
+
+    ping = true;
+}
+
+void exit_cache_t::disable(vmx::exit_reason reason)
+{
+    switch (reason)
+    {
+    case vmx::exit_reason::cpuid:
+        cpuid_count = 0;
+        break;
+    case vmx::exit_reason::vmcall:
+        ping = false;
+        break;
+    default:
+        break;
+    }
+}
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include "heye/config.hpp"
+#include "heye/arch/vmx.hpp"
+
+#include <cstdint>
+
+namespace heye
+{
+/// Cached CPUID result. Layout is shared with `cpuid_entry_t` in vmm.asm.
+///
+struct cpuid_entry_t
+{
+    uint32_t leaf;
+    uint32_t subleaf;
+    /// Result depends on the subleaf in ecx.
+    ///
+    uint32_t indexed;
+    /// Bit of ecx that mirrors guest CR4 bit `cr4_bit`, e.g. OSXSAVE. Patched on every hit,
+    /// since the guest can change CR4 after the leaf is cached. Zero `cr4_bit` means none.
+    ///
+    uint8_t  cr4_bit;
+    uint8_t  ecx_bit;
+    uint16_t reserved;
+    int      regs[4];
+};
+static_assert(sizeof(cpuid_entry_t) == 32);
+
+/// Per vcpu data of the assembly fast path that resumes the guest without calling
+/// the exit handler. Layout is shared with `exit_cache_t` in vmm.asm.
+///
+struct exit_cache_t
+{
+    static constexpr auto max_cpuid = 16;
+
+    uint32_t      cpuid_count;
+    /// Ping vmcall is resumed without calling the exit handler.
+    ///
+    uint32_t      ping;
+    uint32_t      reserved[2];
+    cpuid_entry_t cpuid[max_cpuid];
+
+    /// Execute cached CPUID leaves. Must run on the processor that owns the cache,
+    /// since some leaves report processor specific values (e.g. APIC ID).
+    ///
+    void fill();
+
+    /// Send exits of the reason to the exit handler, e.g. because user registered
+    /// its own handler. Lasts until the next `fill`.
+    ///
+    void disable(vmx::exit_reason reason);
+};
+static_assert(sizeof(exit_cache_t) == 16 + 32 * exit_cache_t::max_cpuid);
+};
@@ -0,0 +1,224 @@
+#include "heye/hv/hook.hpp"
+#include "heye/hv/hypervisor.hpp"
+#include "heye/hv/vmx.hpp"
+#include "heye/arch/arch.hpp"
+#include "heye/shared/trace.hpp"
+
+namespace heye
+{
+/// Point the entry to `page_pa` with the given permissions.
+///
+static void remap(pte_t* entry, uint64_t page_pa, bool read, bool write, bool execute)
+{
+    pte_t value = *entry;
+    value.read    = read;
+    value.write   = write;
+    value.execute = execute;
+    value.pfn     = pfn(page_pa);
+    _InterlockedExchange64(reinterpret_cast<volatile long long*>(&entry->flags), static_cast<long long>(value.flags));
+}
+
+/// Remap entries of the page in views that copied its table from the global EPT.
+/// Views still sharing the table are covered by the global entry.
+///
+static void remap_views(ept_views_t* views, const ept_hook_t* hook, const pte_t* entry, uint64_t page_pa, bool read, bool write, bool execute)
+{
+    views->for_each([&](ept_t* view)
+    {
+        if (!view->is_view())
+            return;
+
+        auto own = view->pte(hook->pa);
+        if (own == entry)
+            return;
+        // View copied the page directory while the page was still mapped by a large page.
+        //
+        if (own == nullptr)
+            own = view->split(hook->pa);
+
+        if (own == nullptr)
+        {
+            logger::error<logger::category_t::ept>("Failed to split EPT view page 0x%llx", hook->pa);
+            return;
+        }
+        remap(own, page_pa, read, write, execute);
+    });
+}
+
+ept_hooks_t::ept_hooks_t(hv_t* hv) : hv(hv), records(sizeof(ept_hook_t), ept_hook_count), shadows(page_size, ept_hook_count, page_size)
+{
+}
+
+ept_hooks_t::~ept_hooks_t()
+{
+    records.report("EPT hooks");
+}
+
+ept_hook_t* ept_hooks_t::create(uint64_t pa)
+{
+    if (!read<msr::vmx_ept_vpid_cap>().rwx_x_only)
+    {
+        logger::warn<logger::category_t::ept>("Execute only EPT pages are not supported");
+        return nullptr;
+    }
+
+    pa &= ~static_cast<uint64_t>(page_size - 1);
+
+    const auto original = va_from_pa(pa);
+    if (original == nullptr)
+        return nullptr;
+
+    auto hook = records.create<ept_hook_t>();
+    if (hook == nullptr)
+    {
+        logger::warn<logger::category_t::ept>("No EPT hooks left");
+        return nullptr;
+    }
+
+    hook->shadow = static_cast<uint8_t*>(shadows.allocate());
+    if (hook->shadow == nullptr)
+    {
+        records.destroy(hook);
+        return nullptr;
+    }
+    __movsb(hook->shadow, static_cast<const uint8_t*>(original), page_size);
+
+    hook->pa               = pa;
+    hook->shadow_pa        = pa_from_va(hook->shadow);
+    hook->handler.callback = handle_violation;
+    hook->handler.context  = hook;
+    return hook;
+}
+
+void ept_hooks_t::destroy(ept_hook_t* hook)
+{
+    if (hook == nullptr || is_installed(hook))
+        return;
+
+    shadows.free(hook->shadow);
+    records.destroy(hook);
+}
+
+size_t ept_hooks_t::install(ept_hook_t* const* hooks, size_t count)
+{
+    std::lock_guard guard(hv->ept_lock);
+
+    size_t installed{};
+
+    for (size_t i = 0; i < count; i++)
+    {
+        auto hook = hooks[i];
+        if (is_installed(hook))
+            continue;
+
+        auto entry = hv->ept->split(hook->pa);
+        if (entry == nullptr)
+        {
+            logger::error<logger::category_t::ept>("Failed to split EPT page 0x%llx", hook->pa);
+            continue;
+        }
+
+        if (!hv->violations->insert(hook->pa, page_size, &hook->handler))
+            continue;
+
+        hook->entry = entry;
+        hook->armed = true;
+        remap(entry, hook->shadow_pa, false, false, true);
+        remap_views(hv->views, hook, entry, hook->shadow_pa, false, false, true);
+        installed++;
+    }
+    // Processors keep using cached translations until invalidation,
+    // so hooks become active at once.
+    //
+    if (installed != 0)
+    {
+        hv->invalidate_ept();
+    }
+    return installed;
+}
+
+void ept_hooks_t::remove(ept_hook_t* const* hooks, size_t count)
+{
+    // Merge below must not race another batch splitting a page of the same table.
+    //
+    std::lock_guard guard(hv->ept_lock);
+
+    size_t removed{};
+
+    for (size_t i = 0; i < count; i++)
+    {
+        auto hook = hooks[i];
+        if (!is_installed(hook) || !hook->armed)
+            continue;
+
+        hook->armed = false;
+        hv->violations->remove(hook->pa, page_size);
+        removed++;
+    }
+
+    if (removed == 0)
+        return;
+
+    // Handler running on another processor might have seen the hook armed and still
+    // remap the page. Processors handle one exit at a time, so once every one of them
+    // passed another exit nobody touches the entries anymore.
+    //
+    hv->invalidate_ept();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        auto hook = hooks[i];
+        if (!is_installed(hook) || hook->armed)
+            continue;
+
+        remap(hook->entry, hook->pa, true, true, true);
+        remap_views(hv->views, hook, hook->entry, hook->pa, true, true, true);
+        hook->entry = nullptr;
+        // Page table of the hook is no longer needed if the whole 2MB page is unhooked.
+        // Table is retired and reclaimed by the invalidation below.
+        //
+        hv->ept->merge(hook->pa);
+    }
+    hv->invalidate_ept();
+}
+
+bool ept_hooks_t::handle_violation(vcpu_t* vcpu, const ept_violation_t& violation, void* context)
+{
+    auto hook = static_cast<ept_hook_t*>(context);
+    // Hook might have been removed after the violation was raised.
+    // Guest retries the access until the original mapping is restored.
+    //
+    if (!hook->armed)
+        return true;
+
+    // Views that copied the page table have their own entry of the page.
+    //
+    auto entry = hook->entry;
+    const auto views = vcpu->owner()->views;
+    if (views->count() > 1)
+    {
+        const auto view = views->find(read<vmx::vmcs::ept_pointer>());
+        const auto own  = view != nullptr ? view->pte(hook->pa) : nullptr;
+        if (own != nullptr)
+            entry = own;
+    }
+
+    // Instruction that reads its own page keeps switching between the two mappings,
+    // so hooked pages must not contain data referenced by their code.
+    //
+    if (violation.qualification.execute)
+    {
+        _InterlockedIncrement64(&hook->executes);
+        remap(entry, hook->shadow_pa, false, false, true);
+    }
+    else
+    {
+        _InterlockedIncrement64(violation.qualification.write ? &hook->writes : &hook->reads);
+        remap(entry, hook->pa, true, true, false);
+    }
+    // Other processors fault on their own stale translations and flip the page again.
+    //
+    views->invalidate();
+    return true;
+}
+};
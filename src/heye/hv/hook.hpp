@@ -0,0 +1,99 @@
+#pragma once
+#include "slab.hpp"
+#include "violation.hpp"
+
+#include "heye/arch/paging.hpp"
+
+namespace heye
+{
+struct hv_t;
+
+/// Execute only EPT hook of a single guest physical page. Instruction fetches are served
+/// from the shadow copy, reads and writes from the original page. Hook applies to every
+/// EPT view: views sharing the page table see the global entry, views that copied it get
+/// their own entry hooked at install and flipped by the handler of the faulting view.
+///
+struct ept_hook_t
+{
+    /// Guest physical address of the hooked page.
+    ///
+    uint64_t pa;
+
+    /// Copy of the original page. Patch it before installing the hook.
+    ///
+    uint8_t* shadow;
+
+    /// Number of violations that switched the page to the shadow copy.
+    ///
+    volatile long long executes;
+
+    /// Number of violations that switched the page back to the original.
+    ///
+    volatile long long reads;
+    volatile long long writes;
+
+private:
+    friend struct ept_hooks_t;
+
+    ept_handler_t handler;
+
+    /// Physical address of the shadow copy. Translated at creation, since the handler
+    /// runs in vmx root and can't ask the kernel.
+    ///
+    uint64_t shadow_pa;
+
+    /// Leaf entry of the page in the global EPT. Set while the hook is installed.
+    ///
+    pte_t* entry;
+
+    /// Cleared when removal starts. Handler leaves the page alone afterwards.
+    ///
+    volatile bool armed;
+};
+
+/// Batched EPT hook installation. Every batch ends with a single EPT invalidation
+/// on all processors instead of one per hook.
+///
+struct ept_hooks_t
+{
+    ept_hooks_t (hv_t* hv);
+    ~ept_hooks_t();
+
+    /// Allocate hook of the page containing `pa` with shadow copy of its content.
+    /// Must be called at passive level. Returns `nullptr` if processor doesn't support
+    /// execute only EPT pages, the page has no virtual mapping or `ept_hook_count` hooks exist.
+    ///
+    ept_hook_t* create(uint64_t pa);
+
+    /// Free hook. Hook must not be installed.
+    ///
+    void destroy(ept_hook_t* hook);
+
+    /// Install hooks and invalidate EPT once. Must be called at passive level.
+    /// Returns number of installed hooks. Hooks that failed have no `entry`.
+    ///
+    size_t install(ept_hook_t* const* hooks, size_t count);
+
+    /// Restore original mappings and invalidate EPT once. Waits until every processor
+    /// passed a vm exit first, so handlers that already started can't remap the page
+    /// after it is restored. Must be called at passive level.
+    ///
+    void remove(ept_hook_t* const* hooks, size_t count);
+
+    /// Check if hook is installed.
+    ///
+    static bool is_installed(const ept_hook_t* hook) { return hook->entry != nullptr; }
+
+private:
+    /// Flip page between the shadow copy and the original on violation. Runs in vmx root.
+    ///
+    static bool handle_violation(vcpu_t* vcpu, const ept_violation_t& violation, void* context);
+
+    hv_t* hv;
+
+    /// Hooks and their shadow pages, reserved up front.
+    ///
+    slab_t records;
+    slab_t shadows;
+};
+};
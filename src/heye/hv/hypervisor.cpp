@@ -7,35 +7,34 @@
 
 namespace heye
 {
-hv_t::hv_t(setup_cb_t setup, teardown_cb_t teardown, vmexit_cb_t vmexit) : state(state_t::off), kernel_page_table(read<cr3_t>())
+hv_t::hv_t(setup_cb_t setup, teardown_cb_t teardown, exit_callback_t vmexit)
+    : vcpu(per_cpu_index, this, setup, teardown, vmexit.handler, vmexit.state), state(state_t::off), kernel_page_table(read<cr3_t>())
 {
-    // Although all `new` allocations come from `ExAllocatePoolZero`, we zero initialize vcpu array.
+    shootdown = new shootdown_t(this);
+    // Allocate EPT split pool and initialize ept.
     //
-    __stosb(reinterpret_cast<unsigned char*>(vcpu), 0, sizeof(vcpu));
-    // Allocate and initialize vcpu.
+    ept_pool = new table_pool_t;
+    ept      = new ept_t(ept_pool);
+    views    = new ept_views_t(ept, shootdown);
+    // Handlers are registered by the user before or after start.
     //
-    for (size_t core = 0; core < cpu::count(); core++)
-    {
-        vcpu[core] = new vcpu_t(this, setup, teardown, vmexit);
-    }
-    // Allocate and initialize ept.
-    //
-    ept = new ept_t;
+    violations = new violation_table_t;
+    hooks      = new ept_hooks_t(this);
+    exits      = new exit_table_t(this);
 }
 
 hv_t::~hv_t()
 {
     stop();
-    // Delete all vcpu instances.
+    // Vcpu instances are destroyed with `vcpu`.
     //
-    for (auto core : vcpu)
-    {
-        if (core != nullptr)
-        {
-            delete core;
-        }
-    }
+    delete exits;
+    delete hooks;
+    delete violations;
+    delete views;
     delete ept;
+    delete ept_pool;
+    delete shootdown;
 }
 
 bool hv_t::supported()
@@ -62,34 +61,36 @@ bool hv_t::supported()
 
 bool hv_t::start()
 {
-    if (is_running() || !supported())
+    if (is_running() || !vcpu.valid() || !supported())
         return false;
 
-    volatile bool failed_start{ false };
+    if (ept == nullptr || !*ept)
+    {
+        logger::error<logger::category_t::hv>("EPT is not built");
+        return false;
+    }
+
     // Enter VMM on all cores. This function runs at IPI_LEVEL.
+    // Cores only write their own vcpu state, the result is collected afterwards.
     //
-    cpu::for_each([&, this](uint64_t cpu_number)
+    cpu::for_each([this](uint64_t cpu_number)
     {
-        auto current_vcpu = vcpu[cpu_number];
-        if (current_vcpu != nullptr && current_vcpu->is_off())
-        {
-            if (!current_vcpu->start())
-            {
-                logger::info("Failed to virtualize %ld core", cpu_number);
-                failed_start = true;
-            }
-        }
-        else
+        auto& current_vcpu = vcpu[cpu_number];
+        if (current_vcpu.is_off() && !current_vcpu.start())
         {
-            failed_start = true;
+            logger::error<logger::category_t::hv>("Failed to virtualize %ld core", cpu_number);
         }
     });
 
-    _mm_mfence();
+    bool failed_start{ false };
+    for (const auto& core : vcpu)
+    {
+        failed_start |= !core.is_on();
+    }
 
     if (failed_start)
     {
-        logger::info("Failed to start hypervisor");
+        logger::error<logger::category_t::hv>("Failed to start hypervisor");
         stop();
         return false;
     }
@@ -104,14 +105,17 @@ void hv_t::stop()
     //
     cpu::for_each([this](uint64_t cpu_number)
     {
-        if (vcpu[cpu_number] != nullptr)
+        if (cpu_number < vcpu.size())
         {
-            vcpu[cpu_number]->stop();
+            vcpu[cpu_number].stop();
         }
     });
     // Mark state as off.
     //
     state = state_t::off;
+    // Emit messages recorded in vmx root.
+    //
+    logger::drain();
 }
 
 bool hv_t::is_running() const
@@ -119,6 +123,161 @@ bool hv_t::is_running() const
     return state == state_t::on;
 }
 
+size_t hv_t::harvest(frame_bitmap_t& bitmap, access_bit_t bit)
+{
+    // Guest might run on any view, and views that copied a table keep their own flags.
+    // Tables still shared with the root are cleared by the first walk.
+    //
+    size_t count{};
+    {
+        std::lock_guard guard(ept_lock);
+
+        views->for_each([&](ept_t* view)
+        {
+            count += view->harvest(bitmap, bit);
+        });
+    }
+    // Single broadcast for the whole range instead of one per cleared entry.
+    //
+    if (count != 0)
+    {
+        invalidate_ept();
+    }
+    return count;
+}
+
+bool hv_t::enable_pml()
+{
+    if (is_running() || !ept->tracks_access())
+        return false;
+
+    for (auto& core : vcpu)
+    {
+        if (!core.enable_pml())
+        {
+            logger::error<logger::category_t::hv>("Failed to allocate page modification log");
+            for (auto& other : vcpu)
+            {
+                other.disable_pml();
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t hv_t::collect_dirty(frame_bitmap_t& bitmap)
+{
+    if (!is_running())
+        return 0;
+    // Partially filled logs are drained only on request.
+    //
+    cpu::for_each([](uint64_t)
+    {
+        vmx::vmcall(vmcall_reason::pml_flush);
+    });
+
+    size_t count{};
+    bool   overflow{};
+    bool   cleared{};
+
+    // Rings have a single consumer, concurrent callers would pop the same entries.
+    //
+    std::lock_guard consumer(pml_lock);
+    std::lock_guard guard(ept_lock);
+    // Merge rings of all vcpus. Bitmap deduplicates pages written by several vcpus.
+    //
+    for (auto& core : vcpu)
+    {
+        if (core.pml() == nullptr)
+            continue;
+
+        overflow |= core.pml()->overflowed();
+
+        uint64_t pa{};
+        while (core.pml()->pop(pa))
+        {
+            // Processor logs large page only once until its dirty flag is cleared,
+            // so the whole page is reported.
+            //
+            // Page might have been written through any view. Views can map it with
+            // different page sizes, the largest one is reported.
+            //
+            uint64_t size{};
+            views->for_each([&](ept_t* view)
+            {
+                const auto leaf = view->clear(pa, access_bit_t::dirty);
+                size = leaf > size ? leaf : size;
+            });
+            if (size == 0)
+                continue;
+
+            // Flag is cleared even if the caller's bitmap already has the page,
+            // so EPT is invalidated regardless of the count.
+            //
+            cleared = true;
+            if (!bitmap.test(pa))
+            {
+                bitmap.set(pa & ~(size - 1), size);
+                count++;
+            }
+        }
+    }
+
+    if (overflow)
+    {
+        size_t swept{};
+        views->for_each([&](ept_t* view)
+        {
+            swept += view->harvest(bitmap, access_bit_t::dirty);
+        });
+        cleared |= swept != 0;
+        count   += swept;
+    }
+
+    if (cleared)
+    {
+        invalidate_ept();
+    }
+    return count;
+}
+
+bool hv_t::snapshot(stats::exit_stats_t* buffer, size_t length)
+{
+    if constexpr (!exit_stats)
+        return false;
+
+    if (!is_running())
+        return false;
+
+    // Histograms are plain memory, so they are copied directly. Every vcpu only writes its
+    // own, so a copy might be a few samples ahead of its totals at worst.
+    //
+    for (size_t core = 0; core < vcpu.size() && core < length; core++)
+    {
+        if (vcpu[core].statistics() != nullptr)
+            buffer[core] = *vcpu[core].statistics();
+    }
+    return true;
+}
+
+void hv_t::invalidate_ept()
+{
+    std::lock_guard guard(invalidate_lock);
+    // Tables merged before this point are no longer referenced by EPT, but processors
+    // may still cache them until the generation below completes.
+    //
+    ept_pool->seal();
+    if (is_running())
+    {
+        // Views share tables with the global EPT, so all of them are invalidated.
+        //
+        const auto eptp = views->count() > 1 ? 0 : ept->ept_pointer().flags;
+        shootdown->wait(shootdown->invept(eptp));
+    }
+    ept_pool->reclaim();
+}
+
 cr3_t hv_t::system_process_pagetable() const
 {
     return kernel_page_table;
@@ -1,16 +1,24 @@
 #pragma once
 
 #include "ept.hpp"
+#include "dispatch.hpp"
+#include "hook.hpp"
+#include "views.hpp"
+#include "violation.hpp"
 #include "vcpu.hpp"
 #include "vmexit.hpp"
 
 #include "heye/arch/cr.hpp"
+#include "heye/shared/per_cpu.hpp"
 
 namespace heye
 {
 struct hv_t
 {
-    hv_t (setup_cb_t setup, teardown_cb_t teardown, vmexit_cb_t vmexit);
+    /// Exit handler is bound with `exit_callback_t::bind<handler>()` to the guest register
+    /// state it needs saved, see `exit_state_of`. Default is `vmexit::passthrough`.
+    ///
+    hv_t (setup_cb_t setup, teardown_cb_t teardown, exit_callback_t vmexit = exit_callback_t::bind<vmexit::passthrough>());
     ~hv_t();
 
     bool start();
@@ -18,6 +26,33 @@ struct hv_t
 
     bool is_running() const;
 
+    /// Collect and clear accessed or dirty EPT flags of every view into the bitmap, then invalidate
+    /// EPT on every processor once. Returns number of leaf entries that had the flag set.
+    ///
+    size_t harvest(frame_bitmap_t& bitmap, access_bit_t bit);
+
+    /// Enable page modification logging on every vcpu. Must be called before `start`.
+    /// Returns `false` if hypervisor is running, processor doesn't maintain EPT dirty flags
+    /// or a log couldn't be allocated, in which case no vcpu keeps its log.
+    ///
+    bool enable_pml();
+
+    /// Drain page modification logs of every vcpu into the bitmap and clear dirty flags of the
+    /// reported pages, so the next call reports only pages written since. Falls back to sweeping
+    /// EPT dirty flags if any vcpu dropped addresses. Returns number of dirty leaf pages found.
+    ///
+    size_t collect_dirty(frame_bitmap_t& bitmap);
+
+    /// Copy exit latency statistics of every vcpu into the buffer, indexed by processor number.
+    /// Returns `false` if hypervisor isn't running or statistics are disabled. Must be called at passive level.
+    ///
+    bool snapshot(stats::exit_stats_t* buffer, size_t length);
+
+    /// Invalidate EPT derived translations of every view on every processor, then return
+    /// EPT tables retired before the call to the pool. Must be called at passive level.
+    ///
+    void invalidate_ept();
+
     /// Get system process cr3 value.
     ///
     cr3_t system_process_pagetable() const;
@@ -26,19 +61,60 @@ struct hv_t
     ///
     static bool supported();
 
-    /// Virtual machines per core.
+    /// Virtual machines per core, each on its own cache lines.
     ///
-    vcpu_t* vcpu[max_cpu_count];
+    per_cpu<vcpu_t> vcpu;
 
     /// Global EPT pointer used by all vcpus.
     ///
     ept_t* ept;
 
+    /// Preallocated tables used to split EPT large pages in vmx root.
+    ///
+    table_pool_t* ept_pool;
+
+    /// Serializes changes of EPT entries made at passive level, e.g. hooks splitting and
+    /// merging pages of the global EPT or flags cleared by `harvest`. Handlers in vmx root
+    /// never take it.
+    ///
+    std::mutex ept_lock;
+
+    /// Consumer side of the page modification log rings, held by `collect_dirty`
+    /// before `ept_lock`.
+    ///
+    std::mutex pml_lock;
+
+    /// EPT views switched by the guest with `vmfunc`. View 0 is the global EPT.
+    ///
+    ept_views_t* views;
+
+    /// EPT violation handlers keyed by guest physical page.
+    ///
+    violation_table_t* violations;
+
+    /// Cross-core EPT and VPID invalidation.
+    ///
+    shootdown_t* shootdown;
+
+    /// Execute only EPT hooks.
+    ///
+    ept_hooks_t* hooks;
+
+    /// Exit handlers used by `vmexit::passthrough`.
+    ///
+    exit_table_t* exits;
+
 private:
     /// Hypervisor running state.
     ///
     state_t state;
 
+    /// Serializes `invalidate_ept`, so tables retired while one invalidation waits
+    /// are only reclaimed by the next one. Held while the shootdown waits for kicks
+    /// of other processors, so waiters must not spin at dispatch level.
+    ///
+    std::mutex invalidate_lock;
+
     /// CR3 value of the system process.
     /// Used as `host cr3` value in vmcs. Initialized during class construction.
     ///
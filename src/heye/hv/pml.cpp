@@ -0,0 +1,71 @@
+#include "heye/hv/pml.hpp"
+#include "heye/arch/arch.hpp"
+
+namespace heye
+{
+pml_t::pml_t() : head(0), tail(0), lost(0), overflow(0)
+{
+    log = new pml_log_t;
+    if (log == nullptr)
+        return;
+
+    __stosb(reinterpret_cast<unsigned char*>(log), 0, sizeof(pml_log_t));
+}
+
+pml_t::~pml_t()
+{
+    delete log;
+}
+
+uint64_t pml_t::address() const
+{
+    return pa_from_va(log);
+}
+
+void pml_t::drain()
+{
+    // Index points to the next free entry and wraps to 0xffff once the log is full.
+    //
+    const auto index = read<vmx::vmcs::pml_index>() & 0xffff;
+    const auto first = index >= pml_log_t::entries ? 0 : index + 1;
+
+    for (auto i = first; i < pml_log_t::entries; i++)
+    {
+        push(log->address[i] & ~static_cast<uint64_t>(page_size - 1));
+    }
+    write<vmx::vmcs::pml_index>(pml_log_t::entries - 1);
+}
+
+bool pml_t::pop(uint64_t& pa)
+{
+    if (tail == head)
+        return false;
+
+    _ReadWriteBarrier();
+    pa   = ring[tail % pml_ring_size];
+    _ReadWriteBarrier();
+    tail = tail + 1;
+    return true;
+}
+
+bool pml_t::overflowed()
+{
+    return _InterlockedExchange(&overflow, 0) != 0;
+}
+
+void pml_t::push(uint64_t pa)
+{
+    if (head - tail >= pml_ring_size)
+    {
+        // Consumer is too slow. Remember that the ring is incomplete, so
+        // caller falls back to sweeping EPT dirty flags.
+        //
+        lost = lost + 1;
+        _InterlockedExchange(&overflow, 1);
+        return;
+    }
+    ring[head % pml_ring_size] = pa;
+    _ReadWriteBarrier();
+    head = head + 1;
+}
+};
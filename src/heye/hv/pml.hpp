@@ -0,0 +1,65 @@
+#pragma once
+#include "heye/config.hpp"
+
+#include <cstdint>
+
+namespace heye
+{
+/// Page modification log. Processor writes guest physical address of every page whose
+/// EPT dirty flag it sets, from the last entry to the first.
+///
+struct pml_log_t
+{
+    static constexpr auto entries = 512;
+
+    uint64_t address[entries];
+};
+static_assert(sizeof(pml_log_t) == page_size, "PML log size mismatch");
+
+/// Per vcpu page modification logging state. Log page is drained in vmx root into a
+/// single producer, single consumer ring that is read at passive level. Consumers are
+/// serialized by `hv_t::pml_lock`.
+///
+struct pml_t
+{
+    pml_t ();
+    ~pml_t();
+
+    /// Check if construction succeeded. Invalid log must not be used.
+    ///
+    operator bool() const { return log != nullptr; }
+
+    /// Physical address of the log page.
+    ///
+    uint64_t address() const;
+
+    /// Move logged addresses into the ring and reset log index. Must be called in vmx root.
+    ///
+    void drain();
+
+    /// Take next dirty guest physical address from the ring. Returns `false` if ring is empty.
+    ///
+    bool pop(uint64_t& pa);
+
+    /// Check and reset overflow flag. Set if ring was full and addresses were dropped.
+    ///
+    bool overflowed();
+
+    /// Total number of dropped addresses.
+    ///
+    uint64_t dropped() const { return lost; }
+
+private:
+    void push(uint64_t pa);
+
+    pml_log_t* log;
+
+    /// Ring of dirty guest physical addresses.
+    ///
+    uint64_t          ring[pml_ring_size];
+    volatile uint64_t head;
+    volatile uint64_t tail;
+    volatile uint64_t lost;
+    volatile long     overflow;
+};
+};
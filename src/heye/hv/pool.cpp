@@ -0,0 +1,116 @@
+#include "heye/hv/pool.hpp"
+#include "heye/arch/memory.hpp"
+
+#include <intrin.h>
+
+namespace heye
+{
+table_pool_t::table_pool_t() : used{}, retired{}, sealed{}
+{
+    tables = static_cast<table_t*>(allocate_contiguous(sizeof(table_t) * ept_pool_size));
+    base   = tables != nullptr ? pa_from_va(tables) : 0;
+}
+
+table_pool_t::~table_pool_t()
+{
+    free_contiguous(tables);
+}
+
+void* table_pool_t::allocate()
+{
+    if (tables == nullptr)
+        return nullptr;
+
+    for (size_t i = 0; i < bitmap_count; i++)
+    {
+        // Scan for free bit and race other processors for it.
+        //
+        unsigned long bit{};
+        while (_BitScanForward64(&bit, ~static_cast<uint64_t>(used[i])))
+        {
+            if (!_interlockedbittestandset64(&used[i], bit))
+            {
+                auto table = &tables[i * 64 + bit];
+                __stosq(reinterpret_cast<unsigned long long*>(table), 0, sizeof(table_t) / sizeof(uint64_t));
+                return table;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void table_pool_t::free(void* table)
+{
+    const auto i = index(table);
+    _interlockedbittestandreset64(&used[i / 64], i % 64);
+}
+
+void table_pool_t::retire(void* table)
+{
+    const auto i = index(table);
+    _interlockedbittestandset64(&retired[i / 64], i % 64);
+}
+
+void table_pool_t::seal()
+{
+    // Tables retired after this point wait for the next invalidation.
+    //
+    for (size_t i = 0; i < bitmap_count; i++)
+    {
+        const auto mask = _InterlockedExchange64(&retired[i], 0);
+        if (mask != 0)
+        {
+            _InterlockedOr64(&sealed[i], mask);
+        }
+    }
+}
+
+void table_pool_t::reclaim()
+{
+    for (size_t i = 0; i < bitmap_count; i++)
+    {
+        const auto mask = _InterlockedExchange64(&sealed[i], 0);
+        if (mask != 0)
+        {
+            _InterlockedAnd64(&used[i], ~mask);
+        }
+    }
+}
+
+bool table_pool_t::contains(const void* table) const
+{
+    const auto address = reinterpret_cast<uintptr_t>(table);
+    const auto start   = reinterpret_cast<uintptr_t>(tables);
+    return address >= start && address < start + sizeof(table_t) * ept_pool_size;
+}
+
+bool table_pool_t::owns(uint64_t pa) const
+{
+    return tables != nullptr && pa >= base && pa < base + sizeof(table_t) * ept_pool_size;
+}
+
+void* table_pool_t::va(uint64_t pa) const
+{
+    return reinterpret_cast<uint8_t*>(tables) + (pa - base);
+}
+
+uint64_t table_pool_t::pa(const void* va) const
+{
+    return base + (reinterpret_cast<uintptr_t>(va) - reinterpret_cast<uintptr_t>(tables));
+}
+
+size_t table_pool_t::available() const
+{
+    size_t count{};
+    for (auto mask : used)
+    {
+        count += 64 - __popcnt64(static_cast<uint64_t>(mask));
+    }
+    return count;
+}
+
+size_t table_pool_t::index(const void* table) const
+{
+    return static_cast<const table_t*>(table) - tables;
+}
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include "heye/config.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace heye
+{
+/// Pool of preallocated, physically contiguous page tables.
+/// Tables can be taken and returned in vmx root since pool never touches system allocator
+/// after construction.
+///
+struct table_pool_t
+{
+    table_pool_t ();
+    ~table_pool_t();
+
+    /// Take zeroed table from the pool. Returns `nullptr` if pool is exhausted.
+    ///
+    void* allocate();
+
+    /// Return table to the pool immediately.
+    ///
+    void free(void* table);
+
+    /// Mark table as unused but keep it out of the pool until it is sealed and reclaimed.
+    /// Used for tables that might still be cached by other processors.
+    ///
+    void retire(void* table);
+
+    /// Take tables retired so far for the next `reclaim`. Call right before queueing
+    /// the invalidation that flushes them.
+    ///
+    void seal();
+
+    /// Return sealed tables to the pool. Must be called after every processor invalidated
+    /// its EPT caches with a generation published after `seal`.
+    ///
+    void reclaim();
+
+    /// Check if table belongs to the pool.
+    ///
+    bool contains(const void* table) const;
+
+    /// Check if physical address belongs to the pool.
+    ///
+    bool owns(uint64_t pa) const;
+
+    /// Translate physical address of the table to virtual and vice versa.
+    ///
+    void*    va(uint64_t pa) const;
+    uint64_t pa(const void* va) const;
+
+    /// Number of tables left in the pool.
+    ///
+    size_t available() const;
+
+    operator bool() const { return tables != nullptr; }
+
+private:
+    struct table_t
+    {
+        uint8_t data[page_size];
+    };
+    static_assert(sizeof(table_t) == page_size);
+
+    static constexpr auto bitmap_count = ept_pool_size / 64;
+    static_assert(ept_pool_size % 64 == 0, "EPT pool size must be multiple of 64");
+
+    size_t index(const void* table) const;
+
+    /// Physically contiguous tables, so translation is a single subtraction.
+    ///
+    table_t* tables;
+    uint64_t base;
+
+    /// Bit is set if table is taken.
+    ///
+    volatile long long used   [bitmap_count];
+    volatile long long retired[bitmap_count];
+    volatile long long sealed [bitmap_count];
+};
+};
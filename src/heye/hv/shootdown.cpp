@@ -0,0 +1,230 @@
+#include "heye/hv/shootdown.hpp"
+#include "heye/hv/hypervisor.hpp"
+#include "heye/hv/vmcall.hpp"
+#include "heye/hv/vmx.hpp"
+
+#include "heye/shared/cpu.hpp"
+#include "heye/shared/trace.hpp"
+#include "heye/arch/arch.hpp"
+#include "heye/platform/platform.hpp"
+
+namespace heye
+{
+/// Empty linear range.
+///
+static constexpr long long empty_low  = -1;
+static constexpr long long empty_high = 0;
+
+flush_queue_t::flush_queue_t() : flags(0), eptp(0), leaving(0), fallback(0), range{ empty_low, empty_high }, requested(0), done(0)
+{
+}
+
+void flush_queue_t::ept(uint64_t pointer)
+{
+    if (pointer != 0)
+    {
+        const auto current = _InterlockedCompareExchange64(&eptp, static_cast<long long>(pointer), 0);
+        if (current == 0 || current == static_cast<long long>(pointer))
+            return;
+    }
+    _InterlockedOr(&flags, ept_all_contexts);
+}
+
+void flush_queue_t::vpid(uint64_t address, uint64_t size)
+{
+    if (size == 0)
+    {
+        _InterlockedOr(&flags, vpid_context);
+        return;
+    }
+
+    const auto low  = static_cast<long long>(address & ~static_cast<uint64_t>(page_size - 1));
+    const auto high = static_cast<long long>(address + size);
+
+    long long expected[2] = { range[0], range[1] };
+    while (true)
+    {
+        const auto merged_low  = static_cast<uint64_t>(expected[0]) < static_cast<uint64_t>(low)  ? expected[0] : low;
+        const auto merged_high = static_cast<uint64_t>(expected[1]) > static_cast<uint64_t>(high) ? expected[1] : high;
+        if (static_cast<uint64_t>(merged_high - merged_low) > flush_max_pages * page_size)
+        {
+            _InterlockedOr(&flags, vpid_context);
+            return;
+        }
+        // Comparand is updated with the current value on failure.
+        //
+        if (_InterlockedCompareExchange128(range, merged_high, merged_low, expected))
+            return;
+    }
+}
+
+void flush_queue_t::leave(uint64_t view, uint64_t root)
+{
+    // Views are destroyed one at a time, so a single slot is enough.
+    //
+    fallback = static_cast<long long>(root);
+    _InterlockedExchange64(&leaving, static_cast<long long>(view));
+}
+
+void flush_queue_t::publish(uint64_t generation)
+{
+    // Generations are handed out in order but published concurrently, so keep the highest.
+    //
+    auto current = requested;
+    while (current < static_cast<long long>(generation))
+    {
+        const auto previous = _InterlockedCompareExchange64(&requested, static_cast<long long>(generation), current);
+        if (previous == current)
+            break;
+        current = previous;
+    }
+}
+
+void flush_queue_t::process()
+{
+    // Requests are queued before their generation is published, so everything
+    // up to the generation read here is consumed below.
+    //
+    const auto generation = requested;
+    if (generation == done)
+        return;
+
+    // Tables of the view are freed once every vcpu passed this point.
+    //
+    const auto view = _InterlockedExchange64(&leaving, 0);
+    if (view != 0 && read<vmx::vmcs::ept_pointer>() == static_cast<uint64_t>(view))
+        write<vmx::vmcs::ept_pointer>(static_cast<uint64_t>(fallback));
+
+    const auto pending = _InterlockedExchange(&flags, 0);
+    const auto pointer = _InterlockedExchange64(&eptp, 0);
+
+    long long current[2] = { range[0], range[1] };
+    while (!_InterlockedCompareExchange128(range, empty_high, empty_low, current))
+    {
+    }
+
+    if (pending & ept_all_contexts)
+    {
+        vmx::invept(vmx::invept_t::all_contexts);
+    }
+    else if (pointer != 0)
+    {
+        vmx::invept(vmx::invept_t::single_context, pointer);
+    }
+
+    const auto vpid = read<vmx::vmcs::virtual_processor_id>();
+    if (pending & vpid_context)
+    {
+        vmx::invvpid(vmx::invvpid_t::single_context, vpid);
+    }
+    else
+    {
+        for (auto address = static_cast<uint64_t>(current[0]); address < static_cast<uint64_t>(current[1]); address += page_size)
+        {
+            vmx::invvpid(vmx::invvpid_t::linear_address, vpid, address);
+        }
+    }
+    done = generation;
+}
+
+shootdown_t::shootdown_t(hv_t* hv) : hv(hv), generation(0)
+{
+    // Any vm exit processes the queue, so the call only has to exit.
+    //
+    kicks = platform::create_kicks([](void*)
+    {
+        vmx::vmcall(vmcall_reason::flush);
+    }, nullptr);
+
+    if (kicks == nullptr)
+        logger::warn<logger::category_t::hv>("Failed to allocate shootdown DPCs, lagging processors are kicked with IPIs");
+}
+
+shootdown_t::~shootdown_t()
+{
+    platform::destroy_kicks(kicks);
+}
+
+uint64_t shootdown_t::invept(uint64_t eptp)
+{
+    for (auto& vcpu : hv->vcpu)
+    {
+        vcpu.flushes().ept(eptp);
+    }
+    return publish();
+}
+
+uint64_t shootdown_t::invvpid(uint64_t address, uint64_t size)
+{
+    for (auto& vcpu : hv->vcpu)
+    {
+        vcpu.flushes().vpid(address, size);
+    }
+    return publish();
+}
+
+uint64_t shootdown_t::leave(uint64_t view, uint64_t root)
+{
+    for (auto& vcpu : hv->vcpu)
+    {
+        vcpu.flushes().leave(view, root);
+        vcpu.flushes().ept(view);
+    }
+    return publish();
+}
+
+uint64_t shootdown_t::publish()
+{
+    const auto current = static_cast<uint64_t>(_InterlockedIncrement64(&generation));
+    for (auto& vcpu : hv->vcpu)
+    {
+        vcpu.flushes().publish(current);
+    }
+    return current;
+}
+
+bool shootdown_t::completed(uint64_t generation) const
+{
+    for (auto& vcpu : hv->vcpu)
+    {
+        if (vcpu.is_on() && !vcpu.flushes().completed(generation))
+            return false;
+    }
+    return true;
+}
+
+void shootdown_t::wait(uint64_t generation)
+{
+    while (!completed(generation))
+    {
+        // Only processors that didn't exit on their own since the request are kicked.
+        // Kicks are repeated, since the caller might have migrated to another processor.
+        //
+        for (uint64_t index = 0; index < hv->vcpu.size(); index++)
+        {
+            auto& vcpu = hv->vcpu[index];
+            if (!vcpu.is_on() || vcpu.flushes().completed(generation))
+                continue;
+
+            if (index == cpu::current())
+                vmx::vmcall(vmcall_reason::flush);
+            else if (kicks != nullptr)
+                platform::kick(kicks, index);
+        }
+
+        if (kicks == nullptr && !completed(generation))
+        {
+            cpu::for_each([this](uint64_t index)
+            {
+                if (hv->vcpu[index].is_on())
+                    vmx::vmcall(vmcall_reason::flush);
+            });
+        }
+
+        for (auto spin = 0; spin < 1024 && !completed(generation); spin++)
+        {
+            _mm_pause();
+        }
+    }
+}
+};
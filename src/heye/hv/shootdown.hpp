@@ -0,0 +1,107 @@
+#pragma once
+#include "heye/config.hpp"
+#include "heye/platform/platform.hpp"
+
+#include <cstdint>
+
+namespace heye
+{
+struct hv_t;
+
+/// Pending translation invalidations of a single vcpu. Requests from any processor are
+/// coalesced in place with atomic operations and performed by the vcpu on its next vm exit.
+///
+struct flush_queue_t
+{
+    flush_queue_t();
+
+    /// Queue EPT invalidation. Zero or different EPT pointers coalesce into all contexts invalidation.
+    ///
+    void ept(uint64_t eptp);
+
+    /// Queue invalidation of guest linear range. Ranges are merged and fall back to
+    /// single context invalidation once they grow beyond `flush_max_pages`. Zero size
+    /// invalidates the whole context.
+    ///
+    void vpid(uint64_t address, uint64_t size);
+
+    /// Queue switch back to the root EPT if the vcpu runs on the view, e.g. after `vmfunc`.
+    ///
+    void leave(uint64_t view, uint64_t root);
+
+    /// Mark queued requests as part of the generation.
+    ///
+    void publish(uint64_t generation);
+
+    /// Perform queued invalidations. Must be called in vmx root of the owning vcpu.
+    ///
+    void process();
+
+    /// Check if the vcpu has processed every request up to the generation.
+    ///
+    bool completed(uint64_t generation) const { return static_cast<uint64_t>(done) >= generation; }
+
+private:
+    enum : long
+    {
+        ept_all_contexts = 1 << 0,
+        vpid_context     = 1 << 1
+    };
+
+    volatile long      flags;
+    volatile long long eptp;
+    /// EPT pointer of the view the vcpu must leave and the root EPT it switches to.
+    ///
+    volatile long long leaving;
+    volatile long long fallback;
+    /// Pending linear range as [low, high). Updated with 128-bit compare exchange.
+    ///
+    alignas(16) volatile long long range[2];
+
+    volatile long long requested;
+    volatile long long done;
+};
+
+/// Cross-core invalidation of EPT and VPID translations. Requests are queued to every vcpu,
+/// so modifying EPT at runtime doesn't stop all processors at IPI level.
+///
+struct shootdown_t
+{
+    shootdown_t (hv_t* hv);
+    ~shootdown_t();
+
+    /// Queue EPT invalidation on every vcpu. Zero EPT pointer invalidates all contexts.
+    /// Returns generation to wait for.
+    ///
+    uint64_t invept(uint64_t eptp);
+
+    /// Queue invalidation of guest linear range on every vcpu. Zero size invalidates
+    /// the whole context. Returns generation to wait for.
+    ///
+    uint64_t invvpid(uint64_t address, uint64_t size);
+
+    /// Move vcpus running on the EPT view back to the root EPT and invalidate the view
+    /// on every vcpu. Returns generation to wait for.
+    ///
+    uint64_t leave(uint64_t view, uint64_t root);
+
+    /// Check if every running vcpu processed the generation.
+    ///
+    bool completed(uint64_t generation) const;
+
+    /// Kick vcpus that didn't process the generation yet and wait for them.
+    /// Must be called at or below dispatch level outside of vmx root.
+    ///
+    void wait(uint64_t generation);
+
+private:
+    uint64_t publish();
+
+    hv_t*              hv;
+    volatile long long generation;
+
+    /// Deferred procedure calls that make lagging processors exit.
+    ///
+    platform::kicks_t* kicks;
+};
+};
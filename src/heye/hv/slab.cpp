@@ -0,0 +1,170 @@
+#include "heye/hv/slab.hpp"
+#include "heye/shared/trace.hpp"
+
+#include <intrin.h>
+
+namespace heye
+{
+slab_t::slab_t(size_t object_size, size_t capacity, size_t alignment)
+    : size(object_size), capacity(static_cast<uint32_t>(capacity)), head(none), caches()
+{
+    if (alignment < sizeof(uint32_t))
+        alignment = sizeof(uint32_t);
+
+    if (alignment > page_size)
+        alignment = page_size;
+
+    stride = (object_size + alignment - 1) & ~(alignment - 1);
+    // Page sized allocations are page aligned, so every alignment up to a page holds.
+    //
+    objects = new uint8_t[(stride * capacity + page_size - 1) & ~(page_size - 1)];
+    if (objects == nullptr || !caches.valid())
+    {
+        logger::error<logger::category_t::hv>("Failed to reserve %lld objects of %lld bytes", capacity, object_size);
+        // Slab without caches is unusable, `allocate` checks only `objects`.
+        //
+        delete[] objects;
+        objects = nullptr;
+        return;
+    }
+
+    for (auto index = this->capacity; index-- > 0;)
+    {
+        push(index);
+    }
+}
+
+slab_t::~slab_t()
+{
+    delete[] objects;
+}
+
+void* slab_t::allocate()
+{
+    if (objects == nullptr)
+        return nullptr;
+
+    auto index = none;
+    auto& cache = caches.local();
+    if (_InterlockedExchange(&cache.busy, 1) == 0)
+    {
+        // Refill half of the cache at once, so the next allocations don't touch
+        // the shared list.
+        //
+        while (cache.count < slab_cache_size / 2)
+        {
+            const auto free = pop();
+            if (free == none)
+                break;
+
+            cache.indices[cache.count++] = free;
+        }
+
+        if (cache.count != 0)
+            index = cache.indices[--cache.count];
+
+        _InterlockedExchange(&cache.busy, 0);
+    }
+    else
+    {
+        index = pop();
+    }
+
+    if (index == none)
+    {
+        failures.fetch_add(1);
+        return nullptr;
+    }
+
+    const auto count = used.fetch_add(1) + 1;
+    auto current = peak.load();
+    while (count > current && !peak.compare_exchange_weak(current, count))
+        ;
+
+    auto memory = object(index);
+    __stosb(memory, 0, size);
+    return memory;
+}
+
+void slab_t::free(void* memory)
+{
+    if (memory == nullptr)
+        return;
+
+    const auto index = static_cast<uint32_t>((static_cast<uint8_t*>(memory) - objects) / stride);
+    used.fetch_sub(1);
+
+    auto& cache = caches.local();
+    if (_InterlockedExchange(&cache.busy, 1) == 0)
+    {
+        // Return half of a full cache to the shared list, so other processors can take it.
+        //
+        if (cache.count == slab_cache_size)
+        {
+            while (cache.count > slab_cache_size / 2)
+                push(cache.indices[--cache.count]);
+        }
+        cache.indices[cache.count++] = index;
+
+        _InterlockedExchange(&cache.busy, 0);
+    }
+    else
+    {
+        push(index);
+    }
+}
+
+uint32_t slab_t::pop()
+{
+    auto current = head.load();
+    for (;;)
+    {
+        const auto index = static_cast<uint32_t>(current);
+        if (index == none)
+            return none;
+        // Object might be taken and written meanwhile, then the counter has changed
+        // and the exchange fails.
+        //
+        const auto update = ((current >> 32) + 1) << 32 | next(index);
+        if (head.compare_exchange_weak(current, update))
+            return index;
+    }
+}
+
+void slab_t::push(uint32_t index)
+{
+    auto current = head.load();
+    for (;;)
+    {
+        next(index) = static_cast<uint32_t>(current);
+
+        const auto update = ((current >> 32) + 1) << 32 | index;
+        if (head.compare_exchange_weak(current, update))
+            return;
+    }
+}
+
+volatile uint32_t& slab_t::next(uint32_t index) const
+{
+    return *reinterpret_cast<volatile uint32_t*>(object(index));
+}
+
+bool slab_t::contains(const void* memory) const
+{
+    const auto address = reinterpret_cast<uintptr_t>(memory);
+    const auto start   = reinterpret_cast<uintptr_t>(objects);
+    return objects != nullptr && address >= start && address < start + stride * capacity;
+}
+
+slab_t::usage_t slab_t::usage() const
+{
+    return { size, capacity, used.load(), peak.load(), failures.load() };
+}
+
+void slab_t::report(const char* name) const
+{
+    const auto current = usage();
+    logger::info<logger::category_t::hv>("%s: %lld of %lld objects used, peak %lld, %lld failed allocations",
+        name, current.used, current.capacity, current.peak, current.failures);
+}
+};
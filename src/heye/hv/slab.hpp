@@ -0,0 +1,115 @@
+#pragma once
+#include "heye/config.hpp"
+#include "heye/shared/per_cpu.hpp"
+#include "heye/shared/std/atomic.hpp"
+
+#include <cstdint>
+
+namespace heye
+{
+/// Preallocated fixed size objects. Memory is reserved at construction, so objects can be
+/// taken and returned at any IRQL and in vmx root. Free objects live in a lock-free list
+/// shared by all processors, fronted by a small cache per processor.
+///
+struct slab_t
+{
+    struct usage_t
+    {
+        size_t object_size;
+        size_t capacity;
+        size_t used;
+        /// Most objects ever used at once.
+        ///
+        size_t peak;
+        /// Allocations that found the slab exhausted.
+        ///
+        size_t failures;
+    };
+
+    /// Reserve `capacity` objects of `object_size` bytes. Must be called at passive level.
+    /// Alignment can't exceed a page, page aligned objects are padded to whole pages.
+    ///
+    slab_t (size_t object_size, size_t capacity, size_t alignment = 16);
+    ~slab_t();
+
+    /// Take zeroed object. Returns `nullptr` if slab is exhausted.
+    ///
+    void* allocate();
+
+    /// Return object to the slab.
+    ///
+    void free(void* object);
+
+    template<typename T, typename... A>
+    T* create(A&&... args)
+    {
+        auto memory = allocate();
+        return memory != nullptr ? new (memory) T(std::forward<A>(args)...) : nullptr;
+    }
+
+    template<typename T>
+    void destroy(T* object)
+    {
+        if (object == nullptr)
+            return;
+
+        object->~T();
+        free(object);
+    }
+
+    /// Check if object belongs to the slab.
+    ///
+    bool contains(const void* object) const;
+
+    usage_t usage() const;
+
+    /// Log usage and high water mark.
+    ///
+    void report(const char* name) const;
+
+    operator bool() const { return objects != nullptr; }
+
+    slab_t(const slab_t&)            = delete;
+    slab_t& operator=(const slab_t&) = delete;
+
+private:
+    static constexpr uint32_t none = ~0u;
+
+    /// Objects cached by a processor. The flag is taken with an interlocked exchange,
+    /// so a vm exit that interrupted guest code using the cache falls back to the shared list.
+    ///
+    struct cache_t
+    {
+        volatile long busy;
+        uint32_t      count;
+        uint32_t      indices[slab_cache_size];
+    };
+
+    /// Take index from the shared list. Returns `none` if it is empty.
+    ///
+    uint32_t pop();
+    void     push(uint32_t index);
+
+    /// Index of the next free object, stored in the free object itself.
+    ///
+    volatile uint32_t& next(uint32_t index) const;
+
+    uint8_t* object(uint32_t index) const { return objects + index * stride; }
+
+    uint8_t* objects;
+    size_t   size;
+    size_t   stride;
+    uint32_t capacity;
+
+    /// Index of the first free object in the low half and change counter in the high
+    /// half, which keeps a stale `compare_exchange` from succeeding.
+    ///
+    std::atomic<uint64_t> head;
+
+    per_cpu<cache_t> caches;
+
+    std::atomic<uint32_t> used;
+    std::atomic<uint32_t> peak;
+    std::atomic<uint32_t> failures;
+};
+};
@@ -6,20 +6,48 @@
 
 namespace heye
 {
-vcpu_t::vcpu_t(hv_t* owner, setup_cb_t setup_cb, teardown_cb_t teardown_cb, vmexit_cb_t vmexit_cb)
-    : hv(owner), state(state_t::off), setup_cb(setup_cb), teardown_cb(teardown_cb), vmexit_cb(vmexit_cb)
+vcpu_t::vcpu_t(uint64_t core, hv_t* owner, setup_cb_t setup_cb, teardown_cb_t teardown_cb, vmexit_cb_t vmexit_cb, exit_state_t exit_state)
+    : hv(owner), state(state_t::off), setup_cb(setup_cb), teardown_cb(teardown_cb), vmexit_cb(vmexit_cb), exit_state(exit_state), exit_cache(nullptr), latency(nullptr), xsave_area(nullptr),
+      memory(nullptr), vmcs(nullptr), vmxon(nullptr), stack(nullptr), dirty_log(nullptr)
 {
-    vmcs       = new vmx::vmcs_t;
-    vmxon      = new vmx::vmcs_t;
-    io_bitmap  = new vmx::io_bitmap_t;
-    msr_bitmap = new vmx::msr_bitmap_t;
-    stack      = new stack_t;
+    auto size = sizeof(vcpu_memory_t);
+    // Histograms are written on every exit, so they follow the fast path cache.
+    //
+    size = (size + alignof(stats::exit_stats_t) - 1) & ~(alignof(stats::exit_stats_t) - 1);
+    const auto latency_offset = size;
+    if constexpr (exit_stats)
+        size += sizeof(stats::exit_stats_t);
+    // XSAVE area must be 64 byte aligned. Sized for every supported feature, since guest
+    // may enable more of them later.
+    //
+    size = (size + 63) & ~static_cast<size_t>(63);
+    const auto xsave_offset = size;
+    if (exit_state == exit_state_t::xsave)
+    {
+        if (read<cr4_t>().osxsave)
+            size += read<cpuid::extended_state>().xsave_size;
+        else
+            this->exit_state = exit_state_t::sse;
+    }
 
-    __stosb(reinterpret_cast<unsigned char*>(vmcs),       0, sizeof(vmx::vmcs_t));
-    __stosb(reinterpret_cast<unsigned char*>(vmxon),      0, sizeof(vmx::vmcs_t));
-    __stosb(reinterpret_cast<unsigned char*>(io_bitmap),  0, sizeof(vmx::io_bitmap_t));
-    __stosb(reinterpret_cast<unsigned char*>(msr_bitmap), 0, sizeof(vmx::msr_bitmap_t));
-    __stosb(reinterpret_cast<unsigned char*>(stack),      0, sizeof(stack_t));
+    memory = static_cast<vcpu_memory_t*>(allocate_contiguous(size, cpu::node(core)));
+    if (memory == nullptr)
+    {
+        logger::error<logger::category_t::vcpu>("Failed to allocate %lld bytes for %lld core", size, core);
+        return;
+    }
+
+    const auto base = reinterpret_cast<uint8_t*>(memory);
+    vmxon      = &memory->vmxon;
+    vmcs       = &memory->vmcs;
+    stack      = &memory->stack;
+    exit_cache = &memory->exit_cache;
+
+    if constexpr (exit_stats)
+        latency = reinterpret_cast<stats::exit_stats_t*>(base + latency_offset);
+
+    if (this->exit_state == exit_state_t::xsave)
+        xsave_area = base + xsave_offset;
 }
 
 vcpu_t::~vcpu_t()
@@ -27,16 +55,32 @@ vcpu_t::~vcpu_t()
     if (!is_off())
         stop();
 
-    delete   vmcs;
-    delete   vmxon;
-    delete   io_bitmap;
-    delete   msr_bitmap;
-    delete[] stack;
+    free_contiguous(memory);
+    delete dirty_log;
+}
+
+bool vcpu_t::enable_pml()
+{
+    if (dirty_log == nullptr)
+        dirty_log = new pml_t;
+
+    if (dirty_log == nullptr || !*dirty_log)
+    {
+        disable_pml();
+        return false;
+    }
+    return true;
+}
+
+void vcpu_t::disable_pml()
+{
+    delete dirty_log;
+    dirty_log = nullptr;
 }
 
 bool vcpu_t::start()
 {
-    if (!is_off())
+    if (!is_off() || memory == nullptr)
         return false;
 
     auto cr0 = read<cr0_t>();
@@ -47,7 +91,7 @@ bool vcpu_t::start()
     auto cr0_fixed1 = read<msr::vmx_cr0_fixed1>();
     if ((~cr0.flags & cr0_fixed0.flags) || (~cr0.flags & cr0_fixed1.flags))
     {
-        logger::info("Host CR0 is not allowed in VMX operation");
+        logger::error<logger::category_t::vcpu>("Host CR0 is not allowed in VMX operation");
         return false;
     }
     // Check VMX support.
@@ -57,7 +101,7 @@ bool vcpu_t::start()
     {
         if (!controls.vmxon)
         {
-            logger::info("VMX disabled in BIOS");
+            logger::error<logger::category_t::vcpu>("VMX disabled in BIOS");
             return false;
         }
     }
@@ -82,7 +126,7 @@ bool vcpu_t::start()
     //
     if (vmx::on(pa_from_va(vmxon)))
     {
-        logger::info("__vmxon failed");
+        logger::error<logger::category_t::vcpu>("__vmxon failed");
         return false;
     }
     // Mark as `init`.
@@ -94,27 +138,30 @@ bool vcpu_t::start()
 
     if (vmx::clear(pa_from_va(vmcs)) || vmx::vmptrld(pa_from_va(vmcs)))
     {
-        logger::info("__vmx_clear || __vmx_vmptrld failed");
+        logger::error<logger::category_t::vcpu>("__vmx_clear || __vmx_vmptrld failed");
         return false;
     }
 
     if (!setup_guest() || !setup_host() || !setup_controls())
     {
-        logger::info("Failed to setup vmcs");
+        logger::error<logger::category_t::vcpu>("Failed to setup vmcs");
         return false;
     }
 
+    // Cache CPUID results of this processor for the fast path.
+    //
+    setup_exit_cache();
     // Pass control to the user defined callback.
     //
     setup_cb(this);
 
     if (vmx::launch())
     {
-        logger::info("Failed to launch with code: 0x%lx", read<vmx::vmcs::vm_instruction_error>());
+        logger::error<logger::category_t::vcpu>("Failed to launch with code: 0x%lx", read<vmx::vmcs::vm_instruction_error>());
     }
     else
     {
-        logger::info("running in vmx non-root");
+        logger::info<logger::category_t::vcpu>("running in vmx non-root");
         state = state_t::on;
     }
     return is_on();
@@ -122,7 +169,7 @@ bool vcpu_t::start()
 
 void vcpu_t::stop()
 {
-    logger::info("Leaving vmx root operation");
+    logger::info<logger::category_t::vcpu>("Leaving vmx root operation");
 
     if (is_on())
     {
@@ -141,8 +188,6 @@ void vcpu_t::stop()
     //
     __stosb(reinterpret_cast<unsigned char*>(vmcs),       0, sizeof(vmx::vmcs_t));
     __stosb(reinterpret_cast<unsigned char*>(vmxon),      0, sizeof(vmx::vmcs_t));
-    __stosb(reinterpret_cast<unsigned char*>(io_bitmap),  0, sizeof(vmx::io_bitmap_t));
-    __stosb(reinterpret_cast<unsigned char*>(msr_bitmap), 0, sizeof(vmx::msr_bitmap_t));
     __stosb(reinterpret_cast<unsigned char*>(stack),      0, sizeof(stack_t));
     // Mark state as `off`.
     //
@@ -180,7 +225,7 @@ bool vcpu_t::setup_host()
     err |= write<vmx::vmcs::host_sysenter_eip>(read<msr::sysenter_eip>().flags);
     // Host rip points to vmexit stub.
     //
-    err |= write<vmx::vmcs::host_rip>(reinterpret_cast<uintptr_t>(vmexit_stub));
+    err |= write<vmx::vmcs::host_rip>(reinterpret_cast<uintptr_t>(exit_stub()));
     // Host rsp points to the top of allocated stack.
     //
     // (Low)               |
@@ -194,41 +239,125 @@ bool vcpu_t::setup_host()
     // |  vmexit callback  |
     // +-------------------+
     // |       vcpu*       |
+    // +-------------------+
+    // |   exit cache*     |
+    // +-------------------+
+    // |     exit tsc      |
     // +-------------------+ <- 0x2000 (stack base + stack size)
     // (High)              |
     //
-    stack->vmexit_handler = vmexit_cb;
+    stack->vmexit_handler = handle_exit;
     stack->vcpu = this;
-    err |= write<vmx::vmcs::host_rip>(reinterpret_cast<uint64_t>(vmexit_stub));
+    stack->exit_cache = exit_cache;
+    stack->xsave_area = xsave_area;
+    err |= write<vmx::vmcs::host_rip>(reinterpret_cast<uint64_t>(exit_stub()));
     err |= write<vmx::vmcs::host_rsp>(reinterpret_cast<uint64_t>(&stack->vmexit_handler));
 
     return err == 0;
 }
 
+bool vcpu_t::handle_exit(vcpu_t* vcpu)
+{
+    // Invalidations queued by other processors are performed on any exit, whatever
+    // handler the hypervisor was built with, so shootdowns rarely need a kick.
+    //
+    vcpu->flush.process();
+
+    const auto terminate = vcpu->vmexit_cb(vcpu);
+    // Cached fields are stale after vm entry. Nothing is written back if
+    // the handler leaves vmx operation.
+    //
+    if (terminate)
+    {
+        vcpu->exit_info.invalidate();
+        return true;
+    }
+    // Reason is read before the cache is flushed, it's cached already by any handler.
+    //
+    const auto reason = vcpu->exit_reason();
+    vcpu->exit_info.flush(vcpu->regs());
+
+    if constexpr (exit_stats)
+        vcpu->latency->record(reason, __rdtsc() - vcpu->stack->exit_tsc);
+    return false;
+}
+
+auto vcpu_t::exit_stub() const -> void(*)()
+{
+    // Fast path stubs fall through to the matching full stub. Exits they resume never
+    // reach the handler, so they're only used with the built-in one.
+    //
+    const auto fast = vmexit_fast_path && vmexit_cb == vmexit::passthrough;
+
+    switch (exit_state)
+    {
+    case exit_state_t::gpr:
+        return fast ? vmexit_fast_gpr : vmexit_stub_gpr;
+    case exit_state_t::sse_volatile:
+        return fast ? vmexit_fast_sse_volatile : vmexit_stub_sse_volatile;
+    case exit_state_t::xsave:
+        return fast ? vmexit_fast_xsave : vmexit_stub_xsave;
+    default:
+        return fast ? vmexit_fast : vmexit_stub;
+    }
+}
+
 bool vcpu_t::setup_controls()
 {
     uint64_t err{};
 
-    err |= write<vmx::vmcs::virtual_processor_id>(1);
+    err |= write<vmx::vmcs::virtual_processor_id>(vpid);
 
-    err |= write<vmx::vmcs::pin_based_vm_exec_control>(vmx::adjust(msr::vmx_pinbased_controls{}).flags);
+    // Exiting controls are enabled only for exit reasons that have registered handlers.
+    //
+    const auto exits = hv->exits;
+
+    msr::vmx_pinbased_controls pinbased_controls{};
+    pinbased_controls.flags |= exits->pin_controls();
+    err |= write<vmx::vmcs::pin_based_vm_exec_control>(vmx::adjust(pinbased_controls).flags);
 
     msr::vmx_procbased_controls procbased_controls
     {
         .use_msr_bitmaps        = true,
         .use_secondary_controls = true,
     };
+    procbased_controls.flags |= exits->primary_controls();
     err |= write<vmx::vmcs::cpu_based_vm_exec_control>(vmx::adjust(procbased_controls).flags);
 
+    // EPTP switching lets the guest change EPT views without vm exit.
+    // Its capability msr only exists if vm functions can be enabled.
+    //
+    const auto eptp_switching = vmx::adjust(msr::vmx_procbased_controls2{ .enable_vm_functions = true }).enable_vm_functions
+                             && read<msr::vmx_vmfunc>().eptp_switching;
+    // Page modification logging requires EPT accessed and dirty flags.
+    //
     msr::vmx_procbased_controls2 procbased_controls2
     {
-        .enable_ept     = true,
-        .enable_rdtcp   = true,
-        .enable_vpid    = true,
-        .enable_invpcid = true,
-        .enable_xsaves  = true,
+        .enable_ept          = true,
+        .enable_rdtcp        = true,
+        .enable_vpid         = true,
+        .enable_invpcid      = true,
+        .enable_vm_functions = eptp_switching,
+        .enable_pml          = dirty_log != nullptr && hv->ept->tracks_access(),
+        .enable_xsaves       = true,
     };
-    err |= write<vmx::vmcs::secondary_vm_exec_control>(vmx::adjust(procbased_controls2).flags);
+    procbased_controls2.flags |= exits->secondary_controls();
+    procbased_controls2 = vmx::adjust(procbased_controls2);
+    err |= write<vmx::vmcs::secondary_vm_exec_control>(procbased_controls2.flags);
+
+    if (procbased_controls2.enable_pml)
+    {
+        err |= write<vmx::vmcs::pml_address>(dirty_log->address());
+        err |= write<vmx::vmcs::pml_index>(pml_log_t::entries - 1);
+    }
+
+    if (procbased_controls2.enable_vm_functions)
+    {
+        msr::vmx_vmfunc vmfunc{};
+        vmfunc.eptp_switching = true;
+        err |= write<vmx::vmcs::vmfunc_controls>(vmfunc.flags);
+        err |= write<vmx::vmcs::eptp_list>(hv->views->list_address());
+    }
 
     msr::vmx_exit_controls exit_controls
     {
@@ -242,13 +371,73 @@ bool vcpu_t::setup_controls()
     };
     err |= write<vmx::vmcs::vm_entry_controls>(vmx::adjust(entry_controls).flags);
 
-    err |= write<vmx::vmcs::msr_bitmap>( pa_from_va(msr_bitmap));
+    err |= write<vmx::vmcs::exception_bitmap>(exits->exception_bitmap());
+    err |= write<vmx::vmcs::cr0_guest_host_mask>(exits->cr_mask());
+    err |= write<vmx::vmcs::cr4_guest_host_mask>(exits->cr_mask());
+    err |= write<vmx::vmcs::io_bitmap_a>(exits->io_bitmap_a());
+    err |= write<vmx::vmcs::io_bitmap_b>(exits->io_bitmap_b());
+    err |= write<vmx::vmcs::msr_bitmap>( exits->msr_bitmap());
     err |= write<vmx::vmcs::ept_pointer>(hv->ept->ept_pointer().flags);
     err |= write<vmx::vmcs::vmcs_link_pointer>(~0ull);
 
     return err == 0;
 }
 
+void vcpu_t::update_controls()
+{
+    const auto exits = hv->exits;
+    // Keep controls that aren't owned by the exit table, e.g. PML or VM functions.
+    //
+    msr::vmx_pinbased_controls pinbased_controls{};
+    pinbased_controls.flags = (read<vmx::vmcs::pin_based_vm_exec_control>() & ~exit_table_t::pin_mask)
+                            | exits->pin_controls();
+    write<vmx::vmcs::pin_based_vm_exec_control>(vmx::adjust(pinbased_controls).flags);
+
+    msr::vmx_procbased_controls procbased_controls{};
+    procbased_controls.flags = (read<vmx::vmcs::cpu_based_vm_exec_control>() & ~exit_table_t::primary_mask)
+                             | exits->primary_controls();
+    write<vmx::vmcs::cpu_based_vm_exec_control>(vmx::adjust(procbased_controls).flags);
+
+    msr::vmx_procbased_controls2 procbased_controls2{};
+    procbased_controls2.flags = (read<vmx::vmcs::secondary_vm_exec_control>() & ~exit_table_t::secondary_mask)
+                              | exits->secondary_controls();
+    write<vmx::vmcs::secondary_vm_exec_control>(vmx::adjust(procbased_controls2).flags);
+
+    write<vmx::vmcs::exception_bitmap>(exits->exception_bitmap());
+
+    // Shadows must hold the current values before the guest reads them through the mask.
+    //
+    const auto cr_mask = exits->cr_mask();
+    if (read<vmx::vmcs::cr0_guest_host_mask>() != cr_mask)
+    {
+        write<vmx::vmcs::cr0_read_shadow>(read<vmx::vmcs::guest_cr0>());
+        write<vmx::vmcs::cr4_read_shadow>(read<vmx::vmcs::guest_cr4>());
+        write<vmx::vmcs::cr0_guest_host_mask>(cr_mask);
+        write<vmx::vmcs::cr4_guest_host_mask>(cr_mask);
+    }
+
+    setup_exit_cache();
+}
+
+void vcpu_t::setup_exit_cache()
+{
+    // Exit reasons resumed by the fast path.
+    //
+    static constexpr vmx::exit_reason fast_reasons[] =
+    {
+        vmx::exit_reason::cpuid,
+        vmx::exit_reason::vmcall,
+    };
+
+    exit_cache->fill();
+
+    for (const auto reason : fast_reasons)
+    {
+        if (hv->exits->is_registered(reason))
+            exit_cache->disable(reason);
+    }
+}
+
 bool vcpu_t::setup_guest()
 {
     const auto gdtr = read<gdtr_t>();
@@ -263,10 +452,6 @@ bool vcpu_t::setup_guest()
     const auto tr   = read<segment_t<tr_t>>();
     const auto ldtr = read<segment_t<ldtr_t>>();
 
-    cr0_t cr0_mask{};
-    cr3_t cr3_mask{};
-    cr4_t cr4_mask{};
-
     uint64_t err{};
 
     err |= write<vmx::vmcs::guest_es_selector>(  es.selector.flags);
@@ -301,9 +486,6 @@ bool vcpu_t::setup_guest()
 
     err |= write<vmx::vmcs::guest_sysenter_cs>(read<msr::sysenter_cs>().flags);
 
-    err |= write<vmx::vmcs::cr0_guest_host_mask>(cr0_mask.flags);
-    err |= write<vmx::vmcs::cr4_guest_host_mask>(cr4_mask.flags);
-
     err |= write<vmx::vmcs::cr0_read_shadow>(read<cr0_t>().flags);
     err |= write<vmx::vmcs::cr4_read_shadow>(read<cr4_t>().flags);
 
@@ -332,12 +514,13 @@ bool vcpu_t::setup_guest()
 
 void vcpu_t::skip_instruction()
 {
-    write<vmx::vmcs::guest_rip>(regs().rip + read<vmx::vmcs::vm_exit_instruction_len>());
+    regs().rip += exit_info.instruction_len();
+    exit_info.modify(exit_context_t::guest_rip);
 }
 
 uint64_t vcpu_t::id() const
 {
-    return read<vmx::vmcs::virtual_processor_id>();
+    return vpid;
 }
 
 cpu::regs_t& vcpu_t::regs()
@@ -345,23 +528,6 @@ cpu::regs_t& vcpu_t::regs()
     return stack->regs;
 }
 
-vmx::exit_reason vcpu_t::exit_reason() const
-{
-    return static_cast<vmx::exit_reason>(read<vmx::vmcs::vm_exit_reason>() & 0xffff);
-}
-
-vmx::exit_qualification_t vcpu_t::exit_qualification() const
-{
-    vmx::exit_qualification_t qualification{ read<vmx::vmcs::exit_qualification>() };
-    return qualification;
-}
-
-vmx::vm_interrupt_info_t vcpu_t::exit_interrupt_info() const
-{
-    vmx::vm_interrupt_info_t intr{ read<vmx::vmcs::vm_exit_intr_info>() & 0xffffffff };
-    return intr;
-}
-
 vmx::vm_interrupt_info_t vcpu_t::entry_interrupt_info() const
 {
     vmx::vm_interrupt_info_t intr{ read<vmx::vmcs::vm_entry_intr_info>() & 0xffffffff };
@@ -1,10 +1,15 @@
 #pragma once
 #include "vmx.hpp"
+#include "pml.hpp"
+#include "context.hpp"
+#include "fastpath.hpp"
+#include "shootdown.hpp"
 #include "callbacks.hpp"
 #include "heye/config.hpp"
 #include "heye/arch/arch.hpp"
 
 #include "heye/shared/cpu.hpp"
+#include "heye/shared/stats.hpp"
 
 namespace heye
 {
@@ -26,15 +31,33 @@ struct stack_t
     uint8_t        data[kernel_stack_size
                             - sizeof(cpu::regs_t)
                             - sizeof(frame_t)
-                            - sizeof(uint64_t) * 3];
+                            - sizeof(uint64_t) * 5];
     cpu::regs_t    regs;
     frame_t        frame;
-    uint64_t       unused;
+    uint8_t*       xsave_area;
     vmexit_cb_t    vmexit_handler;
     vcpu_t*        vcpu;
+    exit_cache_t*  exit_cache;
+    /// Timestamp taken by the stub on vm exit.
+    ///
+    uint64_t       exit_tsc;
 };
 static_assert(sizeof(stack_t) == kernel_stack_size);
 
+/// Fixed part of the per vcpu memory block. Pages touched only by the processor or on
+/// start come first. Stack top, where the exit stub saves guest registers, is followed by
+/// the fast path cache, so state used on every exit is adjacent. Latency histograms and
+/// XSAVE area follow when enabled.
+///
+struct vcpu_memory_t
+{
+    vmx::vmcs_t  vmxon;
+    vmx::vmcs_t  vmcs;
+    stack_t      stack;
+    exit_cache_t exit_cache;
+};
+static_assert(offsetof(vcpu_memory_t, stack) % page_size == 0);
+
 enum class state_t : uint32_t
 {
     /// Hypervisor is active.
@@ -52,7 +75,9 @@ enum class state_t : uint32_t
 ///
 struct vcpu_t
 {
-    vcpu_t(hv_t* owner, setup_cb_t setup, teardown_cb_t teardown, vmexit_cb_t vmexit);
+    /// Allocates every per vcpu structure as a single block from the NUMA node of the `core`.
+    ///
+    vcpu_t(uint64_t core, hv_t* owner, setup_cb_t setup, teardown_cb_t teardown, vmexit_cb_t vmexit, exit_state_t exit_state);
     ~vcpu_t();
 
     /// Enter vmx non root.
@@ -69,13 +94,49 @@ struct vcpu_t
 
     void skip_instruction();
 
+    /// Reload exiting controls, exception bitmap and fast path from `hv_t::exits`.
+    /// Must be called in vmx root.
+    ///
+    void update_controls();
+
     uint64_t id() const;
 
+    /// Hypervisor instance that owns this vcpu.
+    ///
+    hv_t* owner() const { return hv; }
+
+    /// Allocate page modification log. Takes effect on the next `start`.
+    /// Returns `false` if the log couldn't be allocated.
+    ///
+    bool enable_pml();
+
+    /// Free page modification log. Must not be called while the vcpu runs.
+    ///
+    void disable_pml();
+
+    /// Page modification log or `nullptr` if logging is disabled.
+    ///
+    pml_t* pml() const { return dirty_log; }
+
+    /// Invalidations requested by other processors.
+    ///
+    flush_queue_t& flushes() { return flush; }
+
     cpu::regs_t& regs();
 
-    vmx::exit_reason          exit_reason()          const;
-    vmx::exit_qualification_t exit_qualification()   const;
-    vmx::vm_interrupt_info_t  exit_interrupt_info()  const;
+    /// VM exit information of the current exit.
+    ///
+    exit_context_t& context() { return exit_info; }
+
+    /// Root mode latency per exit reason or `nullptr` if `exit_stats` is disabled.
+    ///
+    const stats::exit_stats_t* statistics() const { return latency; }
+
+    /// Exit fields are cached in `exit_info`, so these are read on every exit without a call.
+    ///
+    vmx::exit_reason          exit_reason()          const { return static_cast<vmx::exit_reason>(exit_info.reason() & 0xffff); }
+    vmx::exit_qualification_t exit_qualification()   const { return vmx::exit_qualification_t{ exit_info.qualification() }; }
+    vmx::vm_interrupt_info_t  exit_interrupt_info()  const { return vmx::vm_interrupt_info_t{ static_cast<uint32_t>(exit_info.interrupt_info()) }; }
     vmx::vm_interrupt_info_t  entry_interrupt_info() const;
 
 private:
@@ -83,6 +144,23 @@ private:
     bool setup_host();
     bool setup_controls();
 
+    /// Refill fast path cache, leaving out exits the user handles.
+    ///
+    void setup_exit_cache();
+
+    /// Get vm exit stub that saves guest state required by the handler. Fast path stubs are
+    /// used only with `vmexit::passthrough`, other handlers see every exit.
+    ///
+    auto exit_stub() const -> void(*)();
+
+    /// Called by the vm exit stub. Runs user handler and writes back guest registers it modified.
+    ///
+    static bool handle_exit(vcpu_t* vcpu);
+
+    /// Every vcpu uses the same VPID, since they share EPT and guest address spaces.
+    ///
+    static constexpr uint16_t vpid = 1;
+
     /// Hypervisor instance that owns this vcpu.
     ///
     hv_t* hv;
@@ -97,12 +175,33 @@ private:
     teardown_cb_t teardown_cb;
     vmexit_cb_t   vmexit_cb;
 
-    /// Per core global variables.
+    /// Guest state saved by the vm exit stub.
+    ///
+    exit_state_t  exit_state;
+
+    /// Cached CPUID results and allowlisted msrs of the assembly fast path.
+    ///
+    exit_cache_t* exit_cache;
+
+    /// Exit information read during the current exit. Mutable, since it's a cache.
+    ///
+    mutable exit_context_t exit_info;
+
+    /// Exit latency histograms, written only in vmx root of this processor.
+    ///
+    stats::exit_stats_t* latency;
+
+    /// XSAVE area of the `xsave` exit state or `nullptr`.
+    ///
+    uint8_t* xsave_area;
+
+    /// Per core global variables, all but `dirty_log` point into `memory`.
     ///
+    vcpu_memory_t*     memory;
     vmx::vmcs_t*       vmcs;
     vmx::vmcs_t*       vmxon;
-    vmx::io_bitmap_t*  io_bitmap;
-    vmx::msr_bitmap_t* msr_bitmap;
     stack_t*           stack;
+    pml_t*             dirty_log;
+    flush_queue_t      flush;
 };
 };
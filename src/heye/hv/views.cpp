@@ -0,0 +1,118 @@
+#include "heye/hv/views.hpp"
+#include "heye/hv/vmx.hpp"
+#include "heye/arch/arch.hpp"
+#include "heye/shared/trace.hpp"
+
+namespace heye
+{
+ept_views_t::ept_views_t(ept_t* root, shootdown_t* shootdown) : shootdown(shootdown), used(1)
+{
+    // Page sized allocations are page aligned.
+    //
+    list = new uint64_t[max_views];
+
+    __stosb(reinterpret_cast<unsigned char*>(views), 0, sizeof(views));
+    views[0] = root;
+    list [0] = root->ept_pointer().flags;
+}
+
+ept_views_t::~ept_views_t()
+{
+    // Root EPT is owned by the hypervisor.
+    //
+    for (int index = 1; index < max_views; index++)
+    {
+        if (views[index] != nullptr)
+        {
+            delete views[index];
+        }
+    }
+    delete[] list;
+}
+
+int ept_views_t::create()
+{
+    std::lock_guard guard(lock);
+
+    for (int index = 1; index < max_views; index++)
+    {
+        if (views[index] != nullptr)
+            continue;
+
+        auto view = new ept_t(views[0]);
+        if (view == nullptr || !*view)
+        {
+            delete view;
+            return -1;
+        }
+
+        views[index] = view;
+        // Publish the view to processors only after it is fully built.
+        //
+        _mm_mfence();
+        list[index] = view->ept_pointer().flags;
+        _InterlockedIncrement(&used);
+        return index;
+    }
+    logger::warn<logger::category_t::ept>("EPT view list is full");
+    return -1;
+}
+
+void ept_views_t::destroy(int index)
+{
+    std::lock_guard guard(lock);
+
+    if (index <= 0 || index >= max_views || views[index] == nullptr)
+        return;
+
+    // Guest can't switch to the view anymore. Processors that still run on it are moved
+    // back to the root EPT on their next exit, and exits that started before that might
+    // still look the view up, so it is freed only once every processor passed one.
+    //
+    const auto view = views[index];
+    list[index] = 0;
+    shootdown->wait(shootdown->leave(view->ept_pointer().flags, views[0]->ept_pointer().flags));
+
+    views[index] = nullptr;
+    _InterlockedDecrement(&used);
+    delete view;
+}
+
+ept_t* ept_views_t::get(int index) const
+{
+    if (index < 0 || index >= max_views)
+        return nullptr;
+
+    return views[index];
+}
+
+ept_t* ept_views_t::find(uint64_t ept_pointer) const
+{
+    // Other views might be deleted meanwhile, so only the EPTP list is read.
+    // View the processor runs on lives until the current exit ends, see `destroy`.
+    //
+    for (int index = 0; index < max_views; index++)
+    {
+        if (list[index] == ept_pointer)
+            return views[index];
+    }
+    return nullptr;
+}
+
+uint64_t ept_views_t::list_address() const
+{
+    return pa_from_va(list);
+}
+
+void ept_views_t::invalidate() const
+{
+    // Views share tables with the root, so modifying the root affects every view.
+    //
+    if (used > 1)
+    {
+        vmx::invept(vmx::invept_t::all_contexts, 0);
+        return;
+    }
+    views[0]->invalidate();
+}
+};
@@ -0,0 +1,84 @@
+#pragma once
+#include "ept.hpp"
+#include "shootdown.hpp"
+
+#include "heye/shared/std/mutex.hpp"
+
+namespace heye
+{
+/// Alternative EPT views the guest switches between with `vmfunc` without causing vm exit.
+/// View 0 is always the root EPT. Every other view shares tables with it until modified.
+///
+struct ept_views_t
+{
+    static constexpr auto max_views = 512;
+
+    ept_views_t (ept_t* root, shootdown_t* shootdown);
+    ~ept_views_t();
+
+    /// Clone root EPT into a new view. Must be called at passive level.
+    /// Returns index of the view or -1 if the list is full.
+    ///
+    int create();
+
+    /// Remove view from the list, move processors that run on it back to the root EPT,
+    /// invalidate it on every processor and delete it. Must be called at passive level.
+    ///
+    void destroy(int index);
+
+    /// Get view by index. Returns `nullptr` if index is not used.
+    ///
+    ept_t* get(int index) const;
+
+    /// Find view by EPT pointer. Returns `nullptr` if not found. Safe in vmx root
+    /// against concurrent `destroy` for the view the processor runs on.
+    ///
+    ept_t* find(uint64_t ept_pointer) const;
+
+    /// Call `fn` with every view including the root EPT. Views are neither created nor
+    /// destroyed meanwhile. Must be called at passive level.
+    ///
+    template<typename Fn>
+    void for_each(Fn fn)
+    {
+        std::lock_guard guard(lock);
+
+        for (auto view : views)
+        {
+            if (view != nullptr)
+                fn(view);
+        }
+    }
+
+    /// Physical address of the EPTP list.
+    ///
+    uint64_t list_address() const;
+
+    /// Number of views including the root EPT.
+    ///
+    size_t count() const { return used; }
+
+    /// Invalidate EPT derived translations of every view on the current processor.
+    /// Must be called in vmx root.
+    ///
+    void invalidate() const;
+
+private:
+    /// EPTP list read by processor on `vmfunc`. Must be page aligned.
+    ///
+    uint64_t* list;
+
+    /// Views by index.
+    ///
+    ept_t* views[max_views];
+
+    shootdown_t* shootdown;
+
+    /// Serializes `create` and `destroy`. Held while `destroy` waits for the shootdown,
+    /// so it's a passive level mutex. Never taken in vmx root.
+    ///
+    std::mutex lock;
+
+    volatile long used;
+};
+};
@@ -0,0 +1,172 @@
+#include "heye/hv/violation.hpp"
+#include "heye/hv/vcpu.hpp"
+#include "heye/arch/arch.hpp"
+#include "heye/shared/trace.hpp"
+
+namespace heye
+{
+/// Fibonacci hashing spreads consecutive frames of a range over the table.
+///
+static uint64_t hash(uint64_t key)
+{
+    return (key * 0x9e3779b97f4a7c15) >> 32;
+}
+
+ept_violation_t ept_violation_t::decode(vcpu_t* vcpu)
+{
+    ept_violation_t violation{};
+    violation.gpa           = vcpu->context().guest_physical_address();
+    violation.qualification = vcpu->exit_qualification().ept_violation;
+    if (violation.qualification.guest_linear_address_valid)
+        violation.linear_address = vcpu->context().guest_linear_address();
+    return violation;
+}
+
+violation_table_t::violation_table_t() : used(0)
+{
+    slots = new slot_t[capacity];
+    if (slots == nullptr)
+        logger::error<logger::category_t::ept>("Failed to allocate EPT handler table");
+}
+
+violation_table_t::~violation_table_t()
+{
+    delete[] slots;
+}
+
+bool violation_table_t::insert(uint64_t pa, uint64_t size, ept_handler_t* handler)
+{
+    if (slots == nullptr)
+        return false;
+
+    std::lock_guard guard(lock);
+
+    const auto first = pfn(pa);
+    const auto last  = pfn(pa + size - 1);
+
+    for (auto frame = first; frame <= last; frame++)
+    {
+        auto slot = lookup(frame) == nullptr ? claim(frame) : nullptr;
+        if (slot == nullptr)
+        {
+            logger::error<logger::category_t::ept>("Failed to register EPT handler for page 0x%llx", frame << page_shift);
+            for (auto registered = first; registered != frame; registered++)
+                erase(registered);
+            return false;
+        }
+        // Readers match the key first, so the handler must be visible by then.
+        //
+        slot->handler = handler;
+        _InterlockedExchange64(reinterpret_cast<volatile long long*>(&slot->key), static_cast<long long>(frame + 1));
+        _InterlockedIncrement(&used);
+    }
+    return true;
+}
+
+void violation_table_t::remove(uint64_t pa, uint64_t size)
+{
+    if (slots == nullptr)
+        return;
+
+    std::lock_guard guard(lock);
+
+    for (auto frame = pfn(pa); frame <= pfn(pa + size - 1); frame++)
+    {
+        erase(frame);
+    }
+}
+
+ept_handler_t* violation_table_t::find(uint64_t pa) const
+{
+    const auto key  = pfn(pa) + 1;
+    const auto slot = lookup(pfn(pa));
+    if (slot == nullptr)
+        return nullptr;
+
+    // Slot might be removed and reused by another page while it is read.
+    //
+    const auto handler = slot->handler;
+    return slot->key == key ? handler : nullptr;
+}
+
+bool violation_table_t::dispatch(vcpu_t* vcpu, const ept_violation_t& violation) const
+{
+    // Empty table is the common case, so skip hashing entirely.
+    //
+    if (used == 0)
+        return false;
+
+    const auto handler = find(violation.gpa);
+    return handler != nullptr && handler->callback(vcpu, violation, handler->context);
+}
+
+violation_table_t::slot_t* violation_table_t::lookup(uint64_t pfn) const
+{
+    if (slots == nullptr)
+        return nullptr;
+
+    const auto key = pfn + 1;
+    // Linear probing stops at the first empty slot and skips tombstones.
+    //
+    for (uint64_t i = 0, index = hash(key); i < capacity; i++, index++)
+    {
+        auto slot = &slots[index & (capacity - 1)];
+        const auto current = slot->key;
+        if (current == 0)
+            return nullptr;
+
+        if (current == key)
+            return slot;
+    }
+    return nullptr;
+}
+
+violation_table_t::slot_t* violation_table_t::claim(uint64_t pfn)
+{
+    slot_t* reuse{};
+
+    for (uint64_t i = 0, index = hash(pfn + 1); i < capacity; i++, index++)
+    {
+        auto slot = &slots[index & (capacity - 1)];
+        if (slot->key == 0)
+            return reuse != nullptr ? reuse : slot;
+
+        if (slot->key == tombstone && reuse == nullptr)
+            reuse = slot;
+    }
+    return reuse;
+}
+
+void violation_table_t::erase(uint64_t pfn)
+{
+    auto slot = lookup(pfn);
+    if (slot == nullptr)
+        return;
+
+    if (_InterlockedExchangePointer(reinterpret_cast<void* volatile*>(&slot->handler), nullptr) != nullptr)
+        _InterlockedDecrement(&used);
+    release(slot);
+}
+
+void violation_table_t::release(slot_t* slot)
+{
+    auto index = static_cast<uint64_t>(slot - slots);
+    // Chain that ends right after the slot doesn't need it as a link, and neither
+    // does it need the tombstones before it.
+    //
+    if (slots[(index + 1) & (capacity - 1)].key != 0)
+    {
+        slot->key = tombstone;
+        return;
+    }
+
+    slot->key = 0;
+    for (uint64_t i = 1; i < capacity; i++)
+    {
+        auto previous = &slots[(index - i) & (capacity - 1)];
+        if (previous->key != tombstone)
+            break;
+        previous->key = 0;
+    }
+}
+};
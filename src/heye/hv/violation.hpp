@@ -0,0 +1,117 @@
+#pragma once
+#include "heye/config.hpp"
+#include "heye/arch/vmx.hpp"
+#include "heye/shared/std/mutex.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace heye
+{
+struct vcpu_t;
+
+/// EPT violation decoded once per vm exit.
+///
+struct ept_violation_t
+{
+    /// Guest physical address of the access.
+    ///
+    uint64_t gpa;
+
+    /// Guest linear address of the access. Zero if processor didn't provide it.
+    ///
+    uint64_t linear_address;
+
+    /// Access type and EPT permissions of the page.
+    ///
+    vmx::exit_qualification_ept_violation_t qualification;
+
+    /// Read exit qualification, guest physical and linear address of the current exit.
+    /// Must be called in vmx root.
+    ///
+    static ept_violation_t decode(vcpu_t* vcpu);
+};
+
+/// Returns `true` if violation was handled and the guest can retry the access.
+///
+using ept_violation_cb_t = bool(*)(vcpu_t* vcpu, const ept_violation_t& violation, void* context);
+
+/// Registered handler. Must stay valid until it is removed from the table and no processor runs it anymore.
+///
+struct ept_handler_t
+{
+    ept_violation_cb_t callback;
+    void*              context;
+};
+
+/// Guest physical page to EPT violation handler map. Open addressing table read in vmx root
+/// without locks. Writers are serialized by a spinlock and never run in vmx root.
+/// Removed pages leave a tombstone that is reused by the next insert probing over it,
+/// and tombstones followed by an empty slot are released, so chains don't grow over time.
+///
+struct violation_table_t
+{
+    static constexpr auto capacity = ept_handler_table_size;
+    static_assert((capacity & (capacity - 1)) == 0, "Handler table size must be a power of two");
+
+    violation_table_t ();
+    ~violation_table_t();
+
+    /// Register handler for every page of the physical range.
+    /// Returns `false` if any page already has a handler or the table is full,
+    /// in which case pages registered by this call are removed again.
+    ///
+    bool insert(uint64_t pa, uint64_t size, ept_handler_t* handler);
+
+    /// Remove handlers of every page of the physical range.
+    ///
+    void remove(uint64_t pa, uint64_t size);
+
+    /// Get handler of the page containing `pa`. Returns `nullptr` if there is none.
+    ///
+    ept_handler_t* find(uint64_t pa) const;
+
+    /// Run handler registered for the violating page. Returns `false` if there is
+    /// no handler or it didn't handle the violation.
+    ///
+    bool dispatch(vcpu_t* vcpu, const ept_violation_t& violation) const;
+
+    /// Number of pages with handlers.
+    ///
+    size_t count() const { return used; }
+
+private:
+    struct slot_t
+    {
+        /// Page frame number plus one. Zero marks an empty slot, `tombstone` a removed one.
+        ///
+        volatile uint64_t    key;
+        ept_handler_t* volatile handler;
+    };
+
+    static constexpr uint64_t tombstone = ~0ull;
+
+    /// Find slot of the page. Returns `nullptr` if the page has no slot.
+    ///
+    slot_t* lookup(uint64_t pfn) const;
+
+    /// Find free slot for the page, preferring the first tombstone of its chain.
+    /// Returns `nullptr` if the table is full. Must hold `lock`.
+    ///
+    slot_t* claim(uint64_t pfn);
+
+    /// Remove handler of the page and release its slot. Must hold `lock`.
+    ///
+    void erase(uint64_t pfn);
+
+    /// Turn removed slot into tombstone, or release it with the tombstones before it
+    /// if the chain ends right after. Must hold `lock`.
+    ///
+    void release(slot_t* slot);
+
+    slot_t*       slots;
+    volatile long used;
+
+    std::spinlock lock;
+};
+};
@@ -1,3 +1,4 @@
+#include "hypervisor.hpp"
 #include "vmcall.hpp"
 #include "vcpu.hpp"
 #include "vmx.hpp"
@@ -17,15 +18,15 @@ bool handle_vmcall(vcpu_t* vcpu)
     {
     case vmcall_reason::ping:
     {
-        logger::info("pong :)");
+        logger::root<logger::level_t::debug, logger::category_t::exit>("pong :)");
         break;
     }
     case vmcall_reason::vmxoff:
     {
-        logger::info("vmxoff called");
+        logger::root<logger::level_t::info, logger::category_t::exit>("vmxoff called");
         // Set rcx to the next instruction address and rdx to the guest stack pointer.
         //
-        vcpu->regs().rip = read<vmx::vmcs::guest_rip>() + read<vmx::vmcs::vm_exit_instruction_len>();
+        vcpu->regs().rip += vcpu->context().instruction_len();
         // Since we will not vmresume, we must overwrite host cr3 with the guest cr3.
         //
         write<cr3_t> (cr3_t{ read<vmx::vmcs::guest_cr3>() });
@@ -33,9 +34,31 @@ bool handle_vmcall(vcpu_t* vcpu)
         write<idtr_t>(idtr_t{ static_cast<uint16_t>(read<vmx::vmcs::guest_idtr_limit>() & 0xffff), read<vmx::vmcs::guest_idtr_base>() });
         return true;
     }
+    case vmcall_reason::invept:
+    {
+        vcpu->owner()->views->invalidate();
+        break;
+    }
+    case vmcall_reason::pml_flush:
+    {
+        if (vcpu->pml() != nullptr)
+            vcpu->pml()->drain();
+        break;
+    }
+    case vmcall_reason::flush:
+    {
+        vcpu->flushes().process();
+        break;
+    }
+    case vmcall_reason::controls:
+    {
+        vcpu->update_controls();
+        break;
+    }
     default:
         break;
     }
+    vcpu->skip_instruction();
     return false;
 }
 };
@@ -13,10 +13,22 @@ enum class vmcall_reason : uint64_t
 {
     /// Smoke test.
     ///
-    ping   = 0,
+    ping      = 0,
     /// Turn of hypervisor.
     ///
-    vmxoff = 1,
+    vmxoff    = 1,
+    /// Invalidate EPT derived translations on the current processor.
+    ///
+    invept    = 2,
+    /// Drain page modification log of the current processor.
+    ///
+    pml_flush = 3,
+    /// Process pending invalidations of the current processor.
+    ///
+    flush     = 4,
+    /// Reload exiting controls and bitmaps from the exit table.
+    ///
+    controls  = 5,
 };
 
 struct vcpu_t;
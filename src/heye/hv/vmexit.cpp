@@ -1,3 +1,4 @@
+#include "hypervisor.hpp"
 #include "vmexit.hpp"
 #include "vmcall.hpp"
 #include "vcpu.hpp"
@@ -6,8 +7,6 @@
 #include "heye/shared/cpu.hpp"
 #include "heye/arch/arch.hpp"
 
-#include <ntddk.h>
-
 namespace heye
 {
 static void handle_exception(vcpu_t* vcpu)
@@ -30,7 +29,15 @@ static void handle_cpuid(vcpu_t* vcpu)
     // #UD If the LOCK prefix is used.
     //
     int info[4];
-    __cpuidex(info, vcpu->regs().eax, vcpu->regs().ecx);
+    platform::cpuid(info, vcpu->regs().eax, vcpu->regs().ecx);
+    // OSXSAVE and OSPKE report CR4 of the processor, which is the host one in vmx root.
+    //
+    const cr4_t cr4{ read<vmx::vmcs::guest_cr4>() };
+    if (vcpu->regs().eax == 1)
+        info[2] = (info[2] & ~(1 << 27)) | (static_cast<int>(cr4.osxsave) << 27);
+    if (vcpu->regs().eax == 7 && vcpu->regs().ecx == 0)
+        info[2] = (info[2] & ~(1 << 4))  | (static_cast<int>(cr4.pke) << 4);
+
     vcpu->regs().rax = info[0];
     vcpu->regs().rbx = info[1];
     vcpu->regs().rcx = info[2];
@@ -40,7 +47,7 @@ static void handle_cpuid(vcpu_t* vcpu)
 
 static void handle_invd(vcpu_t* vcpu)
 {
-    __wbinvd();
+    platform::wbinvd();
     vcpu->skip_instruction();
 }
 
@@ -79,7 +86,7 @@ static void handle_msr_read(vcpu_t* vcpu)
     default:
         // TODO: Check for valid msr.
         //
-        value = __readmsr(id);
+        value = platform::read_msr(id);
         break;
     }
     vcpu->regs().rax = (value >>  0) & 0xffffffff;
@@ -117,12 +124,50 @@ static void handle_msr_write(vcpu_t* vcpu)
     default:
         // TODO: Check for valid msr.
         //
-        __writemsr(id, value);
+        platform::write_msr(id, value);
         break;
     }
     vcpu->skip_instruction();
 }
 
+static void handle_ept_violation(vcpu_t* vcpu)
+{
+    const auto violation = ept_violation_t::decode(vcpu);
+    if (vcpu->owner()->violations->dispatch(vcpu, violation))
+        return;
+    // EPT only maps physical memory ranges and MMIO below 4GB, so anything else
+    // (e.g. 64-bit PCI BARs) is identity mapped on first access.
+    // Guest might run on any EPT view, so the one in use is mapped.
+    //
+    const auto view = vcpu->owner()->views->find(read<vmx::vmcs::ept_pointer>());
+    if (view == nullptr)
+    {
+        // View is no longer in the list. Root EPT maps everything any view does,
+        // so the guest retries the access there.
+        //
+        write<vmx::vmcs::ept_pointer>(vcpu->owner()->ept->ept_pointer().flags);
+        return;
+    }
+    if (!view->map(violation.gpa))
+    {
+        logger::root<logger::level_t::error, logger::category_t::exit>("Failed to map guest physical address 0x%llx", violation.gpa);
+        __debugbreak();
+    }
+}
+
+static void handle_ept_misconfig(vcpu_t* vcpu)
+{
+    // Misconfiguration means a bug in EPT construction, there is no way to recover.
+    //
+    logger::root<logger::level_t::error, logger::category_t::exit>("EPT misconfiguration at guest physical address 0x%llx", vcpu->context().guest_physical_address());
+    __debugbreak();
+}
+
+static void handle_pml_full(vcpu_t* vcpu)
+{
+    vcpu->pml()->drain();
+}
+
 static void handle_vmx_fallback(vcpu_t*)
 {
     // Inject undefined opcode.
@@ -130,34 +175,33 @@ static void handle_vmx_fallback(vcpu_t*)
     vmx::inject_ud();
 }
 
-namespace vmexit
+template<void(*handler)(vcpu_t*)>
+static bool resume(vcpu_t* vcpu)
 {
-bool passthrough(vcpu_t* vcpu)
+    handler(vcpu);
+    return false;
+}
+
+static bool handle_unexpected(vcpu_t*)
 {
-    bool terminate = false;
+    __debugbreak();
+    return false;
+}
 
-    switch (vcpu->exit_reason())
+namespace vmexit
+{
+exit_handler_t default_handler(vmx::exit_reason reason)
+{
+    switch (reason)
     {
     case vmx::exit_reason::exception_nmi:
-    {
-        handle_exception(vcpu);
-        break;
-    }
+        return resume<handle_exception>;
     case vmx::exit_reason::cpuid:
-    {
-        handle_cpuid(vcpu);
-        break;
-    }
+        return resume<handle_cpuid>;
     case vmx::exit_reason::invd:
-    {
-        handle_invd(vcpu);
-        break;
-    }
+        return resume<handle_invd>;
     case vmx::exit_reason::invlpg:
-    {
-        handle_invlpg(vcpu);
-        break;
-    }
+        return resume<handle_invlpg>;
     case vmx::exit_reason::vmclear:  [[fallthrough]];
     case vmx::exit_reason::vmptrld:  [[fallthrough]];
     case vmx::exit_reason::vmptrst:  [[fallthrough]];
@@ -165,38 +209,29 @@ bool passthrough(vcpu_t* vcpu)
     case vmx::exit_reason::vmresume: [[fallthrough]];
     case vmx::exit_reason::vmwrite:  [[fallthrough]];
     case vmx::exit_reason::vmxoff:   [[fallthrough]];
+    case vmx::exit_reason::vmfunc:   [[fallthrough]];
     case vmx::exit_reason::vmlaunch:
-    {
-        handle_vmx_fallback(vcpu);
-        break;
-    }
-    case vmx::exit_reason::ept_violation: [[fallthrough]];
+        return resume<handle_vmx_fallback>;
+    case vmx::exit_reason::ept_violation:
+        return resume<handle_ept_violation>;
     case vmx::exit_reason::ept_misconfig:
-    {
-        __debugbreak();
-        break;
-    }
-
+        return resume<handle_ept_misconfig>;
     case vmx::exit_reason::msr_read:
-    {
-        handle_msr_read(vcpu);
-        break;
-    }
+        return resume<handle_msr_read>;
     case vmx::exit_reason::msr_write:
-    {
-        handle_msr_write(vcpu);
-        break;
-    }
+        return resume<handle_msr_write>;
+    case vmx::exit_reason::pml_full:
+        return resume<handle_pml_full>;
     case vmx::exit_reason::vmcall:
-    {
-        terminate = handle_vmcall(vcpu);
-        break;
-    }
+        return handle_vmcall;
     default:
-        __debugbreak();
-        break;
+        return handle_unexpected;
     }
-    return terminate;
+}
+
+bool passthrough(vcpu_t* vcpu)
+{
+    return vcpu->owner()->exits->dispatch(vcpu);
 }
 }; // namespace vmexit
 }; // namespace heye
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "vmx.hpp"
+#include "callbacks.hpp"
+#include "dispatch.hpp"
 
 #include <cstdint>
 
@@ -10,6 +12,19 @@ struct vcpu_t;
 
 namespace vmexit
 {
+/// Default exit handler. Calls handler of the exit reason from `hv_t::exits`.
+/// Built-in handlers don't access guest SSE state, so they only need volatile xmm
+/// registers saved.
+///
 bool passthrough(vcpu_t* vcpu);
+
+/// Built-in handler of the exit reason. Breaks into debugger on unexpected exits.
+///
+exit_handler_t default_handler(vmx::exit_reason reason);
+
+static constexpr auto passthrough_state = exit_state_t::sse_volatile;
 };
+
+template<>
+inline constexpr auto exit_state_of<vmexit::passthrough> = vmexit::passthrough_state;
 };
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <intrin.h>
+
+/// Privileged instructions used by the core. The kernel build maps them to intrinsics,
+/// the simulation to a per processor software model, see `simulation/machine.hpp`.
+///
+namespace heye::platform
+{
+#if defined(HEYE_SIMULATION)
+uint64_t read_msr (uint32_t id);
+void     write_msr(uint32_t id, uint64_t value);
+
+void cpuid(int regs[4], int leaf, int subleaf);
+
+uint64_t read_cr (int index);
+void     write_cr(int index, uint64_t value);
+uint64_t read_dr (int index);
+
+uint32_t segment_limit(uint32_t selector);
+
+uint8_t vmread (uint64_t field, uint64_t* value);
+uint8_t vmwrite(uint64_t field, uint64_t  value);
+
+void wbinvd();
+#else
+inline uint64_t read_msr (uint32_t id)                 { return __readmsr(id); }
+inline void     write_msr(uint32_t id, uint64_t value) { __writemsr(id, value); }
+
+inline void cpuid(int regs[4], int leaf, int subleaf) { __cpuidex(regs, leaf, subleaf); }
+
+inline uint64_t read_cr(int index)
+{
+    switch (index)
+    {
+    case 0:  return __readcr0();
+    case 2:  return __readcr2();
+    case 3:  return __readcr3();
+    default: return __readcr4();
+    }
+}
+
+inline void write_cr(int index, uint64_t value)
+{
+    switch (index)
+    {
+    case 0:  __writecr0(value); break;
+    case 3:  __writecr3(value); break;
+    default: __writecr4(value); break;
+    }
+}
+
+inline uint64_t read_dr(int index) { return __readdr(index); }
+
+inline uint32_t segment_limit(uint32_t selector) { return __segmentlimit(selector); }
+
+inline uint8_t vmread (uint64_t field, uint64_t* value) { return __vmx_vmread(field, value); }
+inline uint8_t vmwrite(uint64_t field, uint64_t  value) { return __vmx_vmwrite(field, value); }
+
+inline void wbinvd() { __wbinvd(); }
+#endif
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include "heye/shared/trace_format.hpp"
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+
+/// Services the hypervisor core takes from its environment. The Windows kernel backend
+/// lives in `platform/windows`, the user mode simulation used to build and benchmark
+/// the core on Linux lives in `platform/simulation` and is selected with `HEYE_SIMULATION`.
+/// Privileged instructions are in `instructions.hpp`.
+///
+namespace heye::platform
+{
+/// Preferred node of `allocate_contiguous` when any node will do.
+///
+static constexpr uint32_t any_node = 0x80000000;
+
+/// Allocate zeroed non-paged memory. Allocations of whole pages are page aligned.
+/// Returns `nullptr` on failure. Must be called at passive level.
+///
+void* allocate(size_t size);
+void  free(void* va);
+
+/// Allocate zeroed, page aligned, physically contiguous non-paged memory, preferably
+/// from the NUMA node. Returns `nullptr` on failure. Must be called at passive level.
+///
+void* allocate_contiguous(size_t size, uint32_t node);
+void  free_contiguous(void* va);
+
+uint64_t pa_from_va(const void* va);
+void*    va_from_pa(uint64_t    pa);
+
+/// Call `fn` for every physical RAM range.
+///
+void physical_ranges(void (*fn)(void* context, uint64_t base, uint64_t size), void* context);
+
+/// Number of active processors.
+///
+uint64_t processor_count();
+
+/// Index of the current processor.
+///
+uint64_t current_processor();
+
+/// NUMA node of the processor.
+///
+uint32_t processor_node(uint64_t core);
+
+/// Run `fn` on every processor at IPI level and wait for all of them to finish.
+///
+void broadcast(void (*fn)(void* context, uint64_t core), void* context);
+
+/// Deferred calls of `fn` targeted at single processors, run at dispatch level.
+///
+struct kicks_t;
+
+/// Prepare a deferred call for every processor. Returns `nullptr` on failure.
+/// Must be called at passive level.
+///
+kicks_t* create_kicks(void (*fn)(void* context), void* context);
+void     destroy_kicks(kicks_t* kicks);
+
+/// Queue the call on the processor without waiting for it. A call that is already
+/// queued is not queued again. Must be called at or below dispatch level.
+///
+void kick(kicks_t* kicks, uint64_t core);
+
+/// Give up the rest of the time slice of the current thread. Must be called at passive level.
+///
+void yield();
+
+/// Monotonic counter and its frequency in ticks per second.
+///
+int64_t counter(int64_t* frequency);
+
+/// Write formatted string, always zero terminated.
+///
+void vformat(char* buffer, size_t size, const char* format, va_list args);
+
+/// Log sink of `logger`. `log` may be called at any IRQL but not in vmx root.
+///
+bool log_open();
+void log_close();
+void log(trace::level_t level, trace::category_t category, uint64_t core, uint64_t timestamp, const char* message);
+};
@@ -0,0 +1,84 @@
+#include "machine.hpp"
+
+#include "heye/platform/platform.hpp"
+
+#include <ctime>
+#include <sched.h>
+
+namespace heye::platform
+{
+uint64_t processor_count()
+{
+    return simulation::processors();
+}
+
+uint64_t current_processor()
+{
+    return simulation::current();
+}
+
+uint32_t processor_node(uint64_t core)
+{
+    return simulation::node(core);
+}
+
+void broadcast(void (*fn)(void* context, uint64_t core), void* context)
+{
+    // Processors take turns on the calling thread, as if every IPI ran to completion
+    // before the next one was delivered.
+    //
+    const auto caller = simulation::current();
+    for (uint64_t core = 0; core < simulation::processors(); core++)
+    {
+        simulation::set_current(core);
+        fn(context, core);
+    }
+    simulation::set_current(caller);
+}
+
+struct kicks_t
+{
+    void (*fn)(void* context);
+    void* context;
+};
+
+kicks_t* create_kicks(void (*fn)(void* context), void* context)
+{
+    auto kicks = static_cast<kicks_t*>(allocate(sizeof(kicks_t)));
+    if (kicks == nullptr)
+        return nullptr;
+
+    kicks->fn      = fn;
+    kicks->context = context;
+    return kicks;
+}
+
+void destroy_kicks(kicks_t* kicks)
+{
+    free(kicks);
+}
+
+void kick(kicks_t* kicks, uint64_t core)
+{
+    // Deferred call runs right away on the target processor.
+    //
+    const auto caller = simulation::current();
+    simulation::set_current(core);
+    kicks->fn(kicks->context);
+    simulation::set_current(caller);
+}
+
+void yield()
+{
+    sched_yield();
+}
+
+int64_t counter(int64_t* frequency)
+{
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (frequency != nullptr)
+        *frequency = 1000000000;
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+};
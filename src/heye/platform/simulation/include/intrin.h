@@ -0,0 +1,113 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <x86intrin.h>
+
+/// MSVC intrinsics used by the core, implemented with GCC builtins for the simulation.
+/// Operand types are deduced, since `long` is 64 bit here and 32 bit in MSVC.
+///
+#define HEYE_INTERLOCKED(suffix)                                                                    \
+    template<typename T, typename V>                                                                \
+    inline T _InterlockedExchange ##suffix(volatile T* target, V value)                             \
+    {                                                                                               \
+        return __atomic_exchange_n(target, static_cast<T>(value), __ATOMIC_SEQ_CST);                \
+    }                                                                                               \
+    template<typename T, typename V>                                                                \
+    inline T _InterlockedExchangeAdd ##suffix(volatile T* target, V value)                          \
+    {                                                                                               \
+        return __atomic_fetch_add(target, static_cast<T>(value), __ATOMIC_SEQ_CST);                 \
+    }                                                                                               \
+    template<typename T, typename V>                                                                \
+    inline T _InterlockedOr ##suffix(volatile T* target, V value)                                   \
+    {                                                                                               \
+        return __atomic_fetch_or(target, static_cast<T>(value), __ATOMIC_SEQ_CST);                  \
+    }                                                                                               \
+    template<typename T, typename V>                                                                \
+    inline T _InterlockedAnd ##suffix(volatile T* target, V value)                                  \
+    {                                                                                               \
+        return __atomic_fetch_and(target, static_cast<T>(value), __ATOMIC_SEQ_CST);                 \
+    }                                                                                               \
+    template<typename T, typename V>                                                                \
+    inline T _InterlockedXor ##suffix(volatile T* target, V value)                                  \
+    {                                                                                               \
+        return __atomic_fetch_xor(target, static_cast<T>(value), __ATOMIC_SEQ_CST);                 \
+    }                                                                                               \
+    template<typename T, typename V, typename C>                                                    \
+    inline T _InterlockedCompareExchange ##suffix(volatile T* target, V exchange, C comparand)      \
+    {                                                                                               \
+        auto expected = static_cast<T>(comparand);                                                  \
+        __atomic_compare_exchange_n(target, &expected, static_cast<T>(exchange), false,             \
+            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);                                                    \
+        return expected;                                                                            \
+    }
+
+HEYE_INTERLOCKED(8)
+HEYE_INTERLOCKED(16)
+HEYE_INTERLOCKED()
+HEYE_INTERLOCKED(64)
+HEYE_INTERLOCKED(Pointer)
+
+#undef HEYE_INTERLOCKED
+
+template<typename T> inline T _InterlockedIncrement  (volatile T* target) { return __atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST); }
+template<typename T> inline T _InterlockedDecrement  (volatile T* target) { return __atomic_sub_fetch(target, 1, __ATOMIC_SEQ_CST); }
+template<typename T> inline T _InterlockedIncrement64(volatile T* target) { return __atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST); }
+template<typename T> inline T _InterlockedDecrement64(volatile T* target) { return __atomic_sub_fetch(target, 1, __ATOMIC_SEQ_CST); }
+
+template<typename T>
+inline unsigned char _InterlockedCompareExchange128(volatile T* target, int64_t high, int64_t low, T* comparand)
+{
+    auto expected = reinterpret_cast<unsigned __int128*>(comparand);
+    const auto exchange = static_cast<unsigned __int128>(static_cast<uint64_t>(high)) << 64 | static_cast<uint64_t>(low);
+    return __atomic_compare_exchange_n(reinterpret_cast<volatile unsigned __int128*>(target), expected, exchange, false,
+        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+template<typename T>
+inline unsigned char _interlockedbittestandset64(volatile T* target, int64_t bit)
+{
+    return (__atomic_fetch_or(target, static_cast<T>(1ull << bit), __ATOMIC_SEQ_CST) >> bit) & 1;
+}
+
+template<typename T>
+inline unsigned char _interlockedbittestandreset64(volatile T* target, int64_t bit)
+{
+    return (__atomic_fetch_and(target, static_cast<T>(~(1ull << bit)), __ATOMIC_SEQ_CST) >> bit) & 1;
+}
+
+inline unsigned char _BitScanForward64(unsigned long* index, uint64_t mask)
+{
+    if (mask == 0)
+        return 0;
+    *index = __builtin_ctzll(mask);
+    return 1;
+}
+
+inline unsigned char _BitScanReverse64(unsigned long* index, uint64_t mask)
+{
+    if (mask == 0)
+        return 0;
+    *index = 63 - __builtin_clzll(mask);
+    return 1;
+}
+
+inline uint64_t __popcnt64(uint64_t value) { return __builtin_popcountll(value); }
+
+inline void __stosb(unsigned char* destination, unsigned char value, size_t count) { memset(destination, value, count); }
+inline void __movsb(unsigned char* destination, const unsigned char* source, size_t count) { memcpy(destination, source, count); }
+
+inline void __stosq(unsigned long long* destination, unsigned long long value, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        destination[i] = value;
+}
+
+inline void __movsq(unsigned long long* destination, const unsigned long long* source, size_t count)
+{
+    memcpy(destination, source, count * sizeof(uint64_t));
+}
+
+inline void _ReadWriteBarrier() { __asm__ __volatile__("" ::: "memory"); }
+
+#define __debugbreak() __builtin_trap()
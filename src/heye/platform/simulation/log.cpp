@@ -0,0 +1,27 @@
+#include "heye/platform/platform.hpp"
+
+#include <cstdio>
+
+namespace heye::platform
+{
+bool log_open()
+{
+    return true;
+}
+
+void log_close()
+{
+    fflush(stderr);
+}
+
+void log(trace::level_t level, trace::category_t category, uint64_t core, uint64_t timestamp, const char* message)
+{
+    fprintf(stderr, "[%3llu] %llu %-5s %-7s %s\n", static_cast<unsigned long long>(core), static_cast<unsigned long long>(timestamp),
+        trace::level_name(level), trace::category_name(category), message);
+}
+
+void vformat(char* buffer, size_t size, const char* format, va_list args)
+{
+    vsnprintf(buffer, size, format, args);
+}
+};
@@ -0,0 +1,259 @@
+#include "machine.hpp"
+
+#include "heye/platform/instructions.hpp"
+#include "heye/arch/asm.hpp"
+#include "heye/config.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace heye::simulation
+{
+/// Small open addressed map, enough for the MSRs, leaves and VMCS fields the core touches.
+///
+template<size_t capacity>
+struct registers_t
+{
+    struct entry_t
+    {
+        uint64_t key;
+        uint64_t value;
+        bool     used;
+    };
+
+    entry_t entries[capacity];
+
+    entry_t* find(uint64_t key, bool insert)
+    {
+        for (size_t i = 0; i < capacity; i++)
+        {
+            auto& entry = entries[(key * 0x9e3779b97f4a7c15ull + i) % capacity];
+            if (entry.used && entry.key == key)
+                return &entry;
+
+            if (!entry.used)
+            {
+                if (!insert)
+                    return nullptr;
+
+                entry = { key, 0, true };
+                return &entry;
+            }
+        }
+        fprintf(stderr, "simulation: register map is full\n");
+        abort();
+    }
+
+    uint64_t get(uint64_t key) const
+    {
+        auto entry = const_cast<registers_t*>(this)->find(key, false);
+        return entry != nullptr ? entry->value : 0;
+    }
+
+    void set(uint64_t key, uint64_t value) { find(key, true)->value = value; }
+};
+
+struct cpuid_t
+{
+    int regs[4];
+};
+
+struct processor_t
+{
+    registers_t<1024> vmcs;
+    uint64_t          cr[5];
+    uint64_t          invepts;
+    uint32_t          node;
+};
+
+struct machine_t
+{
+    uint64_t          processors;
+    processor_t       cores[max_cpu_count];
+    registers_t<1024> msrs;
+    registers_t<256>  leaves;
+    cpuid_t           results[256];
+    size_t            result_count;
+    uint64_t          ranges[64][2];
+    size_t            range_count;
+};
+
+static machine_t*          machine = nullptr;
+static thread_local uint64_t core  = 0;
+
+static machine_t& get()
+{
+    if (machine == nullptr)
+        reset(1);
+    return *machine;
+}
+
+void reset(uint64_t processors)
+{
+    if (machine == nullptr)
+        machine = static_cast<machine_t*>(malloc(sizeof(machine_t)));
+
+    *machine = {};
+    machine->processors = processors < 1 ? 1 : processors > max_cpu_count ? max_cpu_count : processors;
+    core = 0;
+    // IA32_MTRR_DEF_TYPE: MTRRs disabled, write back default.
+    //
+    set_msr(0x2ff, 6);
+}
+
+void set_current(uint64_t index)
+{
+    core = index;
+}
+
+uint64_t current()
+{
+    return core;
+}
+
+void set_node(uint64_t index, uint32_t node)
+{
+    get().cores[index].node = node;
+}
+
+void add_physical_range(uint64_t base, uint64_t size)
+{
+    auto& state = get();
+    if (state.range_count < sizeof(state.ranges) / sizeof(state.ranges[0]))
+    {
+        state.ranges[state.range_count][0] = base;
+        state.ranges[state.range_count][1] = size;
+        state.range_count++;
+    }
+}
+
+void set_msr(uint32_t id, uint64_t value)
+{
+    get().msrs.set(id, value);
+}
+
+void set_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t eax, uint32_t ebx, uint32_t ecx, uint32_t edx)
+{
+    auto& state = get();
+    const auto key = static_cast<uint64_t>(leaf) << 32 | subleaf;
+
+    auto entry = state.leaves.find(key, true);
+    if (entry->value == 0)
+    {
+        if (state.result_count == sizeof(state.results) / sizeof(state.results[0]))
+            return;
+        entry->value = ++state.result_count;
+    }
+    state.results[entry->value - 1] = { { static_cast<int>(eax), static_cast<int>(ebx), static_cast<int>(ecx), static_cast<int>(edx) } };
+}
+
+uint64_t vmcs(uint64_t field)
+{
+    return get().cores[core].vmcs.get(field);
+}
+
+uint64_t invepts(uint64_t index)
+{
+    return index < get().processors ? get().cores[index].invepts : 0;
+}
+
+uint64_t processors()
+{
+    return get().processors;
+}
+
+uint32_t node(uint64_t index)
+{
+    return index < get().processors ? get().cores[index].node : 0;
+}
+
+bool physical_range(size_t index, uint64_t& base, uint64_t& size)
+{
+    auto& state = get();
+    if (index >= state.range_count)
+        return false;
+
+    base = state.ranges[index][0];
+    size = state.ranges[index][1];
+    return true;
+}
+};
+
+namespace heye::platform
+{
+uint64_t read_msr(uint32_t id)
+{
+    return simulation::get().msrs.get(id);
+}
+
+void write_msr(uint32_t id, uint64_t value)
+{
+    simulation::get().msrs.set(id, value);
+}
+
+void cpuid(int regs[4], int leaf, int subleaf)
+{
+    auto& state = simulation::get();
+    const auto key = static_cast<uint64_t>(static_cast<uint32_t>(leaf)) << 32 | static_cast<uint32_t>(subleaf);
+    const auto index = state.leaves.get(key);
+    for (int i = 0; i < 4; i++)
+    {
+        regs[i] = index != 0 ? state.results[index - 1].regs[i] : 0;
+    }
+}
+
+uint64_t read_cr(int index)
+{
+    return simulation::get().cores[simulation::core].cr[index];
+}
+
+void write_cr(int index, uint64_t value)
+{
+    simulation::get().cores[simulation::core].cr[index] = value;
+}
+
+uint64_t read_dr(int)
+{
+    return 0;
+}
+
+uint32_t segment_limit(uint32_t)
+{
+    return ~0u;
+}
+
+uint8_t vmread(uint64_t field, uint64_t* value)
+{
+    *value = simulation::get().cores[simulation::core].vmcs.get(field);
+    return 0;
+}
+
+uint8_t vmwrite(uint64_t field, uint64_t value)
+{
+    simulation::get().cores[simulation::core].vmcs.set(field, value);
+    return 0;
+}
+
+void wbinvd()
+{
+}
+};
+
+// Assembly routines of the driver that the portable core calls. There is no hypervisor
+// to call, invalidations are only counted.
+//
+extern "C" uint64_t asm_invept(uint64_t, void*)
+{
+    heye::simulation::get().cores[heye::simulation::core].invepts++;
+    return 0;
+}
+
+extern "C" uint64_t asm_invvpid(uint64_t, void*)
+{
+    return 0;
+}
+
+extern "C" bool asm_vmcall(void*, void*, void*, void*)
+{
+    return false;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/// Software model of the machine behind the simulation backend. Benchmarks and tools
+/// running the core on Linux describe the processors, physical memory and register values
+/// here before using it. Processors run one after another on the calling thread, so the
+/// model needs no locking.
+///
+namespace heye::simulation
+{
+/// Forget every register value and memory range and set the processor count.
+/// MTRRs start disabled with write back default type.
+///
+void reset(uint64_t processors);
+
+uint64_t processors();
+
+/// Processor the calling thread runs as.
+///
+void     set_current(uint64_t core);
+uint64_t current();
+
+/// Set NUMA node of the processor, 0 by default.
+///
+void     set_node(uint64_t core, uint32_t node);
+uint32_t node(uint64_t core);
+
+/// Add range reported by `platform::physical_ranges`.
+///
+void add_physical_range(uint64_t base, uint64_t size);
+
+/// Get range by index. Returns `false` past the last range.
+///
+bool physical_range(size_t index, uint64_t& base, uint64_t& size);
+
+/// MSR value of every processor. Unset MSRs read as 0.
+///
+void set_msr(uint32_t id, uint64_t value);
+
+/// Result of CPUID leaf and subleaf. Unset leaves return zeros.
+///
+void set_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t eax, uint32_t ebx, uint32_t ecx, uint32_t edx);
+
+/// VMCS field of the current processor.
+///
+uint64_t vmcs(uint64_t field);
+
+/// Number of EPT invalidations executed by the processor since `reset`.
+///
+uint64_t invepts(uint64_t core);
+};
@@ -0,0 +1,65 @@
+#include "machine.hpp"
+
+#include "heye/platform/platform.hpp"
+#include "heye/config.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+/// User mode pointers stand in for physical addresses, so translation is identity.
+///
+namespace heye::platform
+{
+void* allocate(size_t size)
+{
+    // Pool allocations of a page or more are page aligned.
+    //
+    void* va = size >= page_size
+        ? aligned_alloc(page_size, (size + page_size - 1) & ~static_cast<size_t>(page_size - 1))
+        : malloc(size);
+
+    if (va != nullptr)
+        memset(va, 0, size);
+    return va;
+}
+
+void free(void* va)
+{
+    ::free(va);
+}
+
+void* allocate_contiguous(size_t size, uint32_t)
+{
+    const auto aligned = (size + page_size - 1) & ~static_cast<size_t>(page_size - 1);
+
+    auto va = aligned_alloc(page_size, aligned);
+    if (va != nullptr)
+        memset(va, 0, aligned);
+    return va;
+}
+
+void free_contiguous(void* va)
+{
+    ::free(va);
+}
+
+uint64_t pa_from_va(const void* va)
+{
+    return reinterpret_cast<uint64_t>(va);
+}
+
+void* va_from_pa(uint64_t pa)
+{
+    return reinterpret_cast<void*>(pa);
+}
+
+void physical_ranges(void (*fn)(void* context, uint64_t base, uint64_t size), void* context)
+{
+    uint64_t base{};
+    uint64_t size{};
+    for (size_t index = 0; simulation::physical_range(index, base, size); index++)
+    {
+        fn(context, base, size);
+    }
+}
+};
@@ -0,0 +1,119 @@
+#include "heye/platform/platform.hpp"
+
+#include <ntddk.h>
+
+namespace heye::platform
+{
+uint64_t processor_count()
+{
+    return KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+}
+
+uint64_t current_processor()
+{
+    return KeGetCurrentProcessorNumberEx(nullptr);
+}
+
+uint32_t processor_node(uint64_t core)
+{
+    PROCESSOR_NUMBER number{};
+    if (!NT_SUCCESS(KeGetProcessorNumberFromIndex(static_cast<ULONG>(core), &number)))
+        return 0;
+
+    for (USHORT node = 0; node <= KeQueryHighestNodeNumber(); node++)
+    {
+        GROUP_AFFINITY affinity{};
+        KeQueryNodeActiveAffinity(node, &affinity, nullptr);
+        if (affinity.Group == number.Group && (affinity.Mask & (1ull << number.Number)) != 0)
+            return node;
+    }
+    return 0;
+}
+
+void broadcast(void (*fn)(void* context, uint64_t core), void* context)
+{
+    struct call_t
+    {
+        void (*fn)(void* context, uint64_t core);
+        void* context;
+    } call{ fn, context };
+
+    KeIpiGenericCall([](uint64_t arg) -> uint64_t
+    {
+        auto call = reinterpret_cast<call_t*>(arg);
+        call->fn(call->context, current_processor());
+        return true;
+    }, reinterpret_cast<uint64_t>(&call));
+}
+
+struct kicks_t
+{
+    void (*fn)(void* context);
+    void* context;
+    KDPC* dpcs;
+};
+
+kicks_t* create_kicks(void (*fn)(void* context), void* context)
+{
+    const auto count = processor_count();
+
+    // DPCs follow the header in the same allocation.
+    //
+    auto kicks = static_cast<kicks_t*>(allocate(sizeof(kicks_t) + count * sizeof(KDPC)));
+    if (kicks == nullptr)
+        return nullptr;
+
+    kicks->fn      = fn;
+    kicks->context = context;
+    kicks->dpcs    = reinterpret_cast<KDPC*>(kicks + 1);
+
+    for (ULONG index = 0; index < count; index++)
+    {
+        PROCESSOR_NUMBER processor{};
+        KeGetProcessorNumberFromIndex(index, &processor);
+
+        KeInitializeDpc(&kicks->dpcs[index], [](PKDPC, PVOID context, PVOID, PVOID)
+        {
+            auto kicks = static_cast<kicks_t*>(context);
+            kicks->fn(kicks->context);
+        }, kicks);
+        KeSetTargetProcessorDpcEx(&kicks->dpcs[index], &processor);
+        KeSetImportanceDpc(&kicks->dpcs[index], HighImportance);
+    }
+    return kicks;
+}
+
+void destroy_kicks(kicks_t* kicks)
+{
+    if (kicks == nullptr)
+        return;
+
+    // Queued DPCs reference the allocation until they ran.
+    //
+    KeFlushQueuedDpcs();
+    free(kicks);
+}
+
+void kick(kicks_t* kicks, uint64_t core)
+{
+    KeInsertQueueDpc(&kicks->dpcs[core], nullptr, nullptr);
+}
+
+void yield()
+{
+    // Shortest relative delay, rounded up to the next clock tick.
+    //
+    LARGE_INTEGER interval{};
+    interval.QuadPart = -1;
+    KeDelayExecutionThread(KernelMode, FALSE, &interval);
+}
+
+int64_t counter(int64_t* frequency)
+{
+    LARGE_INTEGER ticks_per_second{};
+    const auto ticks = KeQueryPerformanceCounter(&ticks_per_second).QuadPart;
+    if (frequency != nullptr)
+        *frequency = ticks_per_second.QuadPart;
+    return ticks;
+}
+};
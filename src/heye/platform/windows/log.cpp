@@ -0,0 +1,69 @@
+#include "heye/platform/platform.hpp"
+
+#include <ntddk.h>
+#include <winmeta.h>
+#include <TraceLoggingProvider.h>
+
+#define _NO_CRT_STDIO_INLINE
+#include <stdio.h>
+
+/// GUID: {60c3d354-edc4-4d20-8132-e16d9eeba96c}
+///
+TRACELOGGING_DECLARE_PROVIDER(provider);
+TRACELOGGING_DEFINE_PROVIDER(
+    provider, "HyperEyeProvider",
+    (0x60c3d354, 0xedc4, 0x4d20, 0x81, 0x32, 0xe1, 0x6d, 0x9e, 0xeb, 0xa9, 0x6c)
+);
+
+namespace heye::platform
+{
+bool log_open()
+{
+    return NT_SUCCESS(TraceLoggingRegister(provider));
+}
+
+void log_close()
+{
+    TraceLoggingUnregister(provider);
+}
+
+#define TRACE_MESSAGE(level)                                    \
+    TraceLoggingWrite(                                          \
+        provider,                                               \
+        "MessageEvent",                                         \
+        TraceLoggingLevel(level),                               \
+        TraceLoggingValue(core, "Core"),                        \
+        TraceLoggingValue(timestamp, "Timestamp"),              \
+        TraceLoggingValue(trace::category_name(category), "Category"), \
+        TraceLoggingValue(message, "Message")                   \
+    )
+
+void log(trace::level_t level, trace::category_t category, uint64_t core, uint64_t timestamp, const char* message)
+{
+    // Event level must be a compile time constant.
+    //
+    switch (level)
+    {
+    case trace::level_t::trace:
+    case trace::level_t::debug:
+        TRACE_MESSAGE(WINEVENT_LEVEL_VERBOSE);
+        break;
+    case trace::level_t::warn:
+        TRACE_MESSAGE(WINEVENT_LEVEL_WARNING);
+        break;
+    case trace::level_t::error:
+        TRACE_MESSAGE(WINEVENT_LEVEL_ERROR);
+        break;
+    default:
+        TRACE_MESSAGE(WINEVENT_LEVEL_INFO);
+        break;
+    }
+}
+
+#undef TRACE_MESSAGE
+
+void vformat(char* buffer, size_t size, const char* format, va_list args)
+{
+    vsprintf_s(buffer, size, format, args);
+}
+};
@@ -0,0 +1,63 @@
+#include "heye/platform/platform.hpp"
+#include "heye/config.hpp"
+
+#include <ntddk.h>
+
+namespace heye::platform
+{
+void* allocate(size_t size)
+{
+    PAGED_CODE();
+    return ExAllocatePoolZero(NonPagedPool, size, pool_tag);
+}
+
+void free(void* va)
+{
+    PAGED_CODE();
+    if (va != nullptr)
+        ExFreePoolWithTag(va, pool_tag);
+}
+
+void* allocate_contiguous(size_t size, uint32_t node)
+{
+    PAGED_CODE();
+    const auto preferred = node == any_node ? MM_ANY_NODE_OK : node;
+
+    auto va = MmAllocateContiguousNodeMemory(size, { .QuadPart = 0 }, { .QuadPart = -1 }, { .QuadPart = 0 }, PAGE_READWRITE, preferred);
+    if (va != nullptr)
+    {
+        __stosb(static_cast<unsigned char*>(va), 0, size);
+    }
+    return va;
+}
+
+void free_contiguous(void* va)
+{
+    PAGED_CODE();
+    if (va != nullptr)
+        MmFreeContiguousMemory(va);
+}
+
+uint64_t pa_from_va(const void* va)
+{
+    return static_cast<uint64_t>(MmGetPhysicalAddress((PVOID)va).QuadPart);
+}
+
+void* va_from_pa(uint64_t pa)
+{
+    return MmGetVirtualForPhysical({ .QuadPart = static_cast<LONGLONG>(pa) });
+}
+
+void physical_ranges(void (*fn)(void* context, uint64_t base, uint64_t size), void* context)
+{
+    auto ranges = MmGetPhysicalMemoryRanges();
+    if (ranges == nullptr)
+        return;
+
+    for (auto range = ranges; range->BaseAddress.QuadPart != 0 || range->NumberOfBytes.QuadPart != 0; range++)
+    {
+        fn(context, range->BaseAddress.QuadPart, range->NumberOfBytes.QuadPart);
+    }
+    ExFreePool(ranges);
+}
+};
@@ -1,26 +1,28 @@
 #include "heye/shared/cpu.hpp"
-
-#include <ntddk.h>
+#include "heye/platform/platform.hpp"
 
 namespace heye::cpu
 {
 uint64_t count()
 {
-    return KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    return platform::processor_count();
 }
 
 uint64_t current()
 {
-    return KeGetCurrentProcessorNumberEx(nullptr);
+    return platform::current_processor();
+}
+
+uint32_t node(uint64_t core)
+{
+    return platform::processor_node(core);
 }
 
 void for_each(core_cb fn)
 {
-    KeIpiGenericCall([](uint64_t arg) -> uint64_t
+    platform::broadcast([](void* context, uint64_t core)
     {
-        auto fn = reinterpret_cast<core_cb*>(arg);
-        (*fn)(current());
-        return true;
-    }, reinterpret_cast<uint64_t>(&fn));
+        (*static_cast<core_cb*>(context))(core);
+    }, &fn);
 }
 };
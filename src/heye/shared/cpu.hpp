@@ -80,6 +80,10 @@ uint64_t count();
 ///
 uint64_t current();
 
+/// Get NUMA node of the cpu.
+///
+uint32_t node(uint64_t core);
+
 /// Run IPI routine on each core.
 ///
 void for_each(core_cb fn);
@@ -0,0 +1,111 @@
+#pragma once
+#include "cpu.hpp"
+#include "std/new.hpp"
+#include "std/utility.hpp"
+
+#include "heye/config.hpp"
+
+#include <cstdint>
+
+namespace heye
+{
+/// Tag of `per_cpu` constructor that passes the processor index to every instance.
+///
+struct per_cpu_index_t {};
+static constexpr per_cpu_index_t per_cpu_index{};
+
+/// @brief Instance of `T` per processor. Instances are padded to whole cache lines, or whole
+/// pages when larger than a page, and the block is page aligned, so writes of one processor
+/// never contend with another. Must be constructed at passive level.
+///
+template<typename T>
+struct per_cpu
+{
+    /// Distance between instances.
+    ///
+    static constexpr size_t stride = sizeof(T) > page_size
+        ? (sizeof(T) + page_size - 1) & ~(page_size - 1)
+        : (sizeof(T) + cache_line_size - 1) & ~(cache_line_size - 1);
+
+    static_assert(alignof(T) <= cache_line_size, "Instance is overaligned");
+
+    /// Construct an instance for every processor with the same arguments.
+    ///
+    template<typename... A>
+    explicit per_cpu(const A&... args) : count(cpu::count())
+    {
+        if (!reserve())
+            return;
+
+        for (size_t core = 0; core < count; core++)
+            new (block + core * stride) T(args...);
+    }
+
+    /// Construct an instance for every processor with its index followed by the arguments.
+    ///
+    template<typename... A>
+    per_cpu(per_cpu_index_t, const A&... args) : count(cpu::count())
+    {
+        if (!reserve())
+            return;
+
+        for (size_t core = 0; core < count; core++)
+            new (block + core * stride) T(core, args...);
+    }
+
+    ~per_cpu()
+    {
+        for (size_t core = 0; core < count; core++)
+            (*this)[core].~T();
+
+        delete[] block;
+    }
+
+    /// Returns `false` if allocation failed.
+    ///
+    bool valid() const { return block != nullptr; }
+
+    size_t size() const { return count; }
+
+    T&       operator[](size_t core)       { return *reinterpret_cast<T*>(block + core * stride); }
+    const T& operator[](size_t core) const { return *reinterpret_cast<const T*>(block + core * stride); }
+
+    /// Instance of the current processor. Caller must not migrate while using it.
+    ///
+    T&       local()       { return (*this)[cpu::current()]; }
+    const T& local() const { return (*this)[cpu::current()]; }
+
+    template<typename V>
+    struct iterator_t
+    {
+        uint8_t* position;
+
+        V&          operator* () const { return *reinterpret_cast<V*>(position); }
+        iterator_t& operator++()       { position += stride; return *this; }
+        bool        operator!=(const iterator_t& other) const { return position != other.position; }
+    };
+
+    iterator_t<T>       begin()       { return { block }; }
+    iterator_t<T>       end()         { return { block + count * stride }; }
+    iterator_t<const T> begin() const { return { block }; }
+    iterator_t<const T> end()   const { return { block + count * stride }; }
+
+    per_cpu(const per_cpu&)            = delete;
+    per_cpu& operator=(const per_cpu&) = delete;
+
+private:
+    bool reserve()
+    {
+        // Page sized allocations are page aligned.
+        //
+        block = new uint8_t[(count * stride + page_size - 1) & ~(page_size - 1)];
+        if (block == nullptr)
+            count = 0;
+
+        return block != nullptr;
+    }
+
+    uint8_t* block;
+    size_t   count;
+};
+};
@@ -0,0 +1,80 @@
+#include "heye/shared/stats.hpp"
+
+namespace heye::stats
+{
+void histogram_t::merge(const histogram_t& other)
+{
+    count  += other.count;
+    cycles += other.cycles;
+    max     = other.max > max ? other.max : max;
+
+    for (uint32_t i = 0; i < buckets; i++)
+    {
+        samples[i] += other.samples[i];
+    }
+}
+
+uint64_t histogram_t::percentile(uint32_t percent) const
+{
+    if (count == 0)
+        return 0;
+
+    const auto target = (count * (percent > 100 ? 100 : percent) + 99) / 100;
+    uint64_t seen{};
+
+    for (uint32_t i = 0; i < buckets - 1; i++)
+    {
+        seen += samples[i];
+        if (seen >= target && seen != 0)
+            return (2ull << i) - 1;
+    }
+    return max;
+}
+
+void exit_stats_t::merge(const exit_stats_t& other)
+{
+    for (size_t i = 0; i < reasons; i++)
+    {
+        reason[i].merge(other.reason[i]);
+    }
+}
+
+uint64_t exit_stats_t::count() const
+{
+    uint64_t total{};
+    for (const auto& histogram : reason)
+    {
+        total += histogram.count;
+    }
+    return total;
+}
+
+uint64_t exit_stats_t::cycles() const
+{
+    uint64_t total{};
+    for (const auto& histogram : reason)
+    {
+        total += histogram.cycles;
+    }
+    return total;
+}
+
+vmx::exit_reason exit_stats_t::hottest() const
+{
+    size_t hottest{};
+    for (size_t i = 1; i < reasons; i++)
+    {
+        if (reason[i].cycles > reason[hottest].cycles)
+            hottest = i;
+    }
+    return static_cast<vmx::exit_reason>(hottest);
+}
+
+void aggregate(const exit_stats_t* stats, size_t count, exit_stats_t& total)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        total.merge(stats[i]);
+    }
+}
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include "heye/arch/vmx.hpp"
+
+#include <cstdint>
+#include <cstddef>
+
+namespace heye::stats
+{
+/// Log2 buckets of TSC cycles. Bucket `n` counts samples in [2^n, 2^(n+1)), the last one
+/// also counts everything longer. 29 buckets make `histogram_t` exactly four cache lines.
+///
+static constexpr uint32_t buckets = 29;
+
+/// Bucket of the sample.
+///
+constexpr uint32_t bucket(uint64_t cycles)
+{
+    uint32_t index = 0;
+    while (cycles > 1 && index < buckets - 1)
+    {
+        cycles >>= 1;
+        index++;
+    }
+    return index;
+}
+
+/// Latency histogram. Has no platform dependencies, so it can be aggregated and
+/// inspected outside of the hypervisor.
+///
+struct alignas(64) histogram_t
+{
+    uint64_t count;
+    uint64_t cycles;
+    uint64_t max;
+    uint64_t samples[buckets];
+
+    void record(uint64_t sample)
+    {
+        count++;
+        cycles += sample;
+        max     = sample > max ? sample : max;
+        samples[bucket(sample)]++;
+    }
+
+    void merge(const histogram_t& other);
+
+    uint64_t mean() const { return count != 0 ? cycles / count : 0; }
+
+    /// Upper bound in cycles of the bucket the percentile falls into.
+    ///
+    uint64_t percentile(uint32_t percent) const;
+};
+static_assert(sizeof(histogram_t) == 256, "Histograms must not share cache lines");
+
+/// Root mode latency of every exit reason on a single vcpu. Written only by the owning
+/// processor, so readers may see a histogram a few samples ahead of its totals.
+///
+struct exit_stats_t
+{
+    static constexpr auto reasons = static_cast<size_t>(vmx::exit_reason::max);
+
+    histogram_t reason[reasons];
+
+    void record(vmx::exit_reason exit_reason, uint64_t sample)
+    {
+        const auto index = static_cast<size_t>(exit_reason);
+        if (index < reasons)
+            reason[index].record(sample);
+    }
+
+    void merge(const exit_stats_t& other);
+
+    /// Total number of exits and cycles spent in root mode.
+    ///
+    uint64_t count()  const;
+    uint64_t cycles() const;
+
+    /// Exit reason with the most cycles spent in root mode.
+    ///
+    vmx::exit_reason hottest() const;
+};
+
+/// Sum statistics of `count` vcpus into `total`.
+///
+void aggregate(const exit_stats_t* stats, size_t count, exit_stats_t& total);
+};
@@ -1,3 +1,157 @@
 #pragma once
+#include "traits.hpp"
 
+#include <intrin.h>
 
+namespace std
+{
+/// @brief std::memory_order. Interlocked instructions are full barriers on x64 and plain
+/// loads and stores already have acquire and release semantics, so only `seq_cst` stores
+/// differ, they use `xchg`.
+///
+enum class memory_order : int
+{
+    relaxed,
+    consume,
+    acquire,
+    release,
+    acq_rel,
+    seq_cst
+};
+
+inline constexpr auto memory_order_relaxed = memory_order::relaxed;
+inline constexpr auto memory_order_acquire = memory_order::acquire;
+inline constexpr auto memory_order_release = memory_order::release;
+inline constexpr auto memory_order_acq_rel = memory_order::acq_rel;
+inline constexpr auto memory_order_seq_cst = memory_order::seq_cst;
+
+namespace detail
+{
+/// Interlocked intrinsic of the operand size. Values are passed as raw bits.
+///
+template<size_t size> struct interlocked;
+
+template<> struct interlocked<1>
+{
+    using type = char;
+    static type exchange(volatile type* target, type value)                  { return _InterlockedExchange8(target, value); }
+    static type compare_exchange(volatile type* target, type value, type cmp) { return _InterlockedCompareExchange8(target, value, cmp); }
+    static type add(volatile type* target, type value)                       { return _InterlockedExchangeAdd8(target, value); }
+    static type bit_or(volatile type* target, type value)                    { return _InterlockedOr8(target, value); }
+    static type bit_and(volatile type* target, type value)                   { return _InterlockedAnd8(target, value); }
+    static type bit_xor(volatile type* target, type value)                   { return _InterlockedXor8(target, value); }
+};
+
+template<> struct interlocked<2>
+{
+    using type = short;
+    static type exchange(volatile type* target, type value)                  { return _InterlockedExchange16(target, value); }
+    static type compare_exchange(volatile type* target, type value, type cmp) { return _InterlockedCompareExchange16(target, value, cmp); }
+    static type add(volatile type* target, type value)                       { return _InterlockedExchangeAdd16(target, value); }
+    static type bit_or(volatile type* target, type value)                    { return _InterlockedOr16(target, value); }
+    static type bit_and(volatile type* target, type value)                   { return _InterlockedAnd16(target, value); }
+    static type bit_xor(volatile type* target, type value)                   { return _InterlockedXor16(target, value); }
+};
+
+template<> struct interlocked<4>
+{
+    using type = long;
+    static type exchange(volatile type* target, type value)                  { return _InterlockedExchange(target, value); }
+    static type compare_exchange(volatile type* target, type value, type cmp) { return _InterlockedCompareExchange(target, value, cmp); }
+    static type add(volatile type* target, type value)                       { return _InterlockedExchangeAdd(target, value); }
+    static type bit_or(volatile type* target, type value)                    { return _InterlockedOr(target, value); }
+    static type bit_and(volatile type* target, type value)                   { return _InterlockedAnd(target, value); }
+    static type bit_xor(volatile type* target, type value)                   { return _InterlockedXor(target, value); }
+};
+
+template<> struct interlocked<8>
+{
+    using type = long long;
+    static type exchange(volatile type* target, type value)                  { return _InterlockedExchange64(target, value); }
+    static type compare_exchange(volatile type* target, type value, type cmp) { return _InterlockedCompareExchange64(target, value, cmp); }
+    static type add(volatile type* target, type value)                       { return _InterlockedExchangeAdd64(target, value); }
+    static type bit_or(volatile type* target, type value)                    { return _InterlockedOr64(target, value); }
+    static type bit_and(volatile type* target, type value)                   { return _InterlockedAnd64(target, value); }
+    static type bit_xor(volatile type* target, type value)                   { return _InterlockedXor64(target, value); }
+};
+};
+
+/// @brief std::atomic of integral, enum and pointer types up to 8 bytes. Safe in vmx
+/// root and at any IRQL, since it's built on interlocked instructions only.
+///
+template<typename T>
+struct atomic
+{
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8, "Unsupported atomic size");
+
+    using value_type = T;
+
+    constexpr atomic() : value() {}
+    constexpr atomic(T desired) : value(desired) {}
+
+    atomic(const atomic&)            = delete;
+    atomic& operator=(const atomic&) = delete;
+
+    T load(memory_order = memory_order::seq_cst) const
+    {
+        const auto result = *const_cast<const volatile T*>(&value);
+        _ReadWriteBarrier();
+        return result;
+    }
+
+    void store(T desired, memory_order order = memory_order::seq_cst)
+    {
+        if (order == memory_order::seq_cst)
+        {
+            exchange(desired);
+            return;
+        }
+        _ReadWriteBarrier();
+        *const_cast<volatile T*>(&value) = desired;
+    }
+
+    T exchange(T desired, memory_order = memory_order::seq_cst)
+    {
+        return from(ops::exchange(target(), to(desired)));
+    }
+
+    bool compare_exchange_strong(T& expected, T desired, memory_order = memory_order::seq_cst)
+    {
+        const auto previous = from(ops::compare_exchange(target(), to(desired), to(expected)));
+        if (previous == expected)
+            return true;
+        expected = previous;
+        return false;
+    }
+
+    bool compare_exchange_weak(T& expected, T desired, memory_order order = memory_order::seq_cst)
+    {
+        return compare_exchange_strong(expected, desired, order);
+    }
+
+    T fetch_add(T arg, memory_order = memory_order::seq_cst) { return from(ops::add(target(), to(arg))); }
+    T fetch_sub(T arg, memory_order = memory_order::seq_cst) { return from(ops::add(target(), static_cast<raw_t>(0 - to(arg)))); }
+    T fetch_or (T arg, memory_order = memory_order::seq_cst) { return from(ops::bit_or(target(), to(arg))); }
+    T fetch_and(T arg, memory_order = memory_order::seq_cst) { return from(ops::bit_and(target(), to(arg))); }
+    T fetch_xor(T arg, memory_order = memory_order::seq_cst) { return from(ops::bit_xor(target(), to(arg))); }
+
+    operator T() const     { return load(); }
+    T operator=(T desired) { store(desired); return desired; }
+
+    T operator++()    { return static_cast<T>(fetch_add(1) + 1); }
+    T operator--()    { return static_cast<T>(fetch_sub(1) - 1); }
+    T operator++(int) { return fetch_add(1); }
+    T operator--(int) { return fetch_sub(1); }
+
+private:
+    using ops   = detail::interlocked<sizeof(T)>;
+    using raw_t = typename ops::type;
+
+    volatile raw_t* target() { return reinterpret_cast<volatile raw_t*>(&value); }
+
+    static raw_t to(T from)     { return (raw_t)(from); }
+    static T     from(raw_t to) { return (T)(to); }
+
+    alignas(sizeof(T)) T value;
+};
+};
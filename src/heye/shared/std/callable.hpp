@@ -1,50 +1,82 @@
 #pragma once
-#include "unique.hpp"
+#include "new.hpp"
+#include "utility.hpp"
+
+#include "heye/config.hpp"
 
 namespace std
 {
-/// cv paste from stackoverflow
+/// @brief std::function without allocation. The callable lives in `capacity` bytes of
+/// inline storage and is invoked through a trampoline, so constructing and calling it is
+/// safe at any IRQL and in vmx root.
 ///
-template<typename F>
+template<typename F, size_t capacity = function_storage>
 struct function{};
 
-template<typename R, typename... A>
-struct function<R(A...)>
+template<typename R, typename... A, size_t capacity>
+struct function<R(A...), capacity>
 {
-private:
-    struct callable
-    {
-        virtual ~callable()              = default;
-        virtual R operator()(A...) const = 0;
-    };
+    function() = default;
 
     template<typename T>
-    struct callable_t : callable
+        requires (!is_same_v<remove_cvref_t<T>, function>)
+    function(T&& fn)
     {
-        callable_t(T&& fn) : fn(std::forward<T>(fn)) {}
+        using callable_t = remove_cvref_t<T>;
 
-        R operator()(A... args) const { return fn(std::forward<A>(args)...); }
+        static_assert(sizeof(callable_t) <= capacity, "Callable doesn't fit in function storage");
+        static_assert(alignof(callable_t) <= alignof(max_align_t), "Callable is overaligned");
 
-    private:
-        T fn;
-    };
+        new (storage) callable_t(std::forward<T>(fn));
 
-    unique_ptr<callable> callable_fn;
+        invoke = [](const void* storage, A... args) -> R
+        {
+            return (*static_cast<const callable_t*>(storage))(std::forward<A>(args)...);
+        };
+        manage = [](void* storage, void* target)
+        {
+            auto fn = static_cast<callable_t*>(storage);
+            if (target != nullptr)
+                new (target) callable_t(std::move(*fn));
+            fn->~callable_t();
+        };
+    }
 
-public:
-    function() = default;
+    function(function&& other) : invoke(other.invoke), manage(other.manage)
+    {
+        if (manage != nullptr)
+            manage(other.storage, storage);
 
-    template<typename T>
-    function(T&& fn) : callable_fn(new callable_t<T>(std::forward<T>(fn))) {}
+        other.invoke = nullptr;
+        other.manage = nullptr;
+    }
+
+    ~function()
+    {
+        if (manage != nullptr)
+            manage(storage, nullptr);
+    }
 
     R operator()(A... args) const
     {
-        return (*callable_fn)(std::forward<A>(args)...);
+        return invoke(storage, std::forward<A>(args)...);
     }
 
-    operator bool() const { return callable_fn; }
+    operator bool() const { return invoke != nullptr; }
+
+    function(const function&)            = delete;
+    function& operator=(const function&) = delete;
+    function& operator=(function&&)      = delete;
+
+private:
+    /// Move the callable to `target` if it is not `nullptr`, then destroy it.
+    ///
+    using manage_t = void(*)(void* storage, void* target);
+    using invoke_t = R(*)(const void* storage, A... args);
+
+    alignas(max_align_t) unsigned char storage[capacity];
 
-    function(const function<R(A ...)>&)            = delete;
-    function& operator=(const function<R(A ...)>&) = delete;
+    invoke_t invoke = nullptr;
+    manage_t manage = nullptr;
 };
 };
@@ -1,36 +1,246 @@
 #pragma once
+#include "atomic.hpp"
+
+#include "heye/config.hpp"
+#include "heye/platform/platform.hpp"
 
 #include <intrin.h>
+#include <cstdint>
 
 namespace std
 {
-/// @brief https://rayanfam.com/topics/hypervisor-from-scratch-part-8/#designing-a-spinlock
+/// @brief Contention statistics of a lock, compiled in with `lock_stats`.
 ///
-struct lock_guard
+template<bool enabled = lock_stats>
+struct lock_stats_t
+{
+    atomic<uint64_t> acquisitions;
+    atomic<uint64_t> contended;
+    /// Number of `pause` instructions executed while waiting.
+    ///
+    atomic<uint64_t> spins;
+
+    void record(uint64_t waited)
+    {
+        acquisitions.fetch_add(1);
+        if (waited != 0)
+        {
+            contended.fetch_add(1);
+            spins.fetch_add(waited);
+        }
+    }
+};
+
+template<>
+struct lock_stats_t<false>
+{
+    void record(uint64_t) {}
+};
+
+/// Bounded exponential backoff of spin loops.
+///
+struct backoff_t
+{
+    static constexpr uint32_t max_wait = 1024;
+
+    uint32_t wait  = 1;
+    uint64_t spins = 0;
+
+    void pause(uint32_t times)
+    {
+        for (uint32_t i = 0; i < times; i++)
+            _mm_pause();
+        spins += times;
+    }
+
+    void operator()()
+    {
+        pause(wait);
+        wait = wait * 2 > max_wait ? max_wait : wait * 2;
+    }
+};
+
+/// @brief Fair ticket spinlock. Uses no OS services, so it can be taken in vmx root, but
+/// a lock must never be shared between vmx root and guest code of the same processor:
+/// vm exit can't wait for the guest it interrupted.
+///
+struct spinlock
+{
+    void lock()
+    {
+        const auto ticket = next.fetch_add(1);
+        backoff_t  backoff;
+
+        for (;;)
+        {
+            const auto current = serving.load();
+            if (current == ticket)
+                break;
+            // Wait proportionally to the position in the queue, so waiters don't hammer
+            // the cache line the owner is about to write.
+            //
+            const auto position = ticket - current;
+            backoff.pause(position * 32 > backoff_t::max_wait ? backoff_t::max_wait : position * 32);
+        }
+        stats.record(backoff.spins);
+    }
+
+    bool try_lock()
+    {
+        auto current = serving.load();
+        auto ticket  = current;
+        if (!next.compare_exchange_strong(ticket, current + 1))
+            return false;
+
+        stats.record(0);
+        return true;
+    }
+
+    void unlock()
+    {
+        // Only the owner writes `serving`.
+        //
+        serving.store(serving.load() + 1, memory_order::release);
+    }
+
+    const lock_stats_t<>& statistics() const { return stats; }
+
+private:
+    atomic<uint32_t> next;
+    atomic<uint32_t> serving;
+    lock_stats_t<>   stats;
+};
+
+/// @brief Mutex of passive level code that waits for other processors while holding it,
+/// e.g. for a shootdown. Long waits give the processor away instead of spinning, so a
+/// waiter never holds off the DPCs the owner waits for. Never taken in vmx root.
+///
+struct mutex
 {
     void lock()
     {
-        // unsigned wait = 1;
+        backoff_t backoff;
+        while (!owner.try_lock())
+        {
+            if (backoff.wait < backoff_t::max_wait)
+                backoff();
+            else
+                heye::platform::yield();
+        }
+    }
+
+    bool try_lock() { return owner.try_lock(); }
+    void unlock()   { owner.unlock(); }
+
+    const lock_stats_t<>& statistics() const { return owner.statistics(); }
+
+private:
+    spinlock owner;
+};
+
+/// @brief Reader-writer spinlock for read-mostly data. Readers only increment a counter.
+/// A writer first claims the writer bit, which holds off new readers, then waits for
+/// current readers to leave, so a steady stream of readers can't starve it.
+///
+struct shared_spinlock
+{
+    void lock()
+    {
+        backoff_t backoff;
+        for (;;)
+        {
+            auto state = this->state.load();
+            if ((state & writer) == 0 && this->state.compare_exchange_strong(state, state | writer))
+                break;
+            backoff();
+        }
 
-        // while (!_lock && !InterlockedBitTestAndSet(&_lock, 0))
-        // {
-        //     for (unsigned i = 0; i < wait; i++)
-        //         _mm_pause();
+        while ((state.load() & readers) != 0)
+            backoff.pause(1);
 
-        //     if (wait * 2 > max_wait)
-        //         wait = max_wait;
-        //     else
-        //         wait *= 2;
-        // }
+        stats.record(backoff.spins);
+    }
+
+    bool try_lock()
+    {
+        uint32_t expected = 0;
+        if (!state.compare_exchange_strong(expected, writer))
+            return false;
+
+        stats.record(0);
+        return true;
     }
 
     void unlock()
     {
-        _lock = 0;
+        state.fetch_and(~writer);
+    }
+
+    void lock_shared()
+    {
+        backoff_t backoff;
+        for (;;)
+        {
+            auto state = this->state.load();
+            if ((state & writer) == 0 && this->state.compare_exchange_strong(state, state + 1))
+                break;
+            backoff();
+        }
+        stats.record(backoff.spins);
+    }
+
+    bool try_lock_shared()
+    {
+        auto state = this->state.load();
+        if ((state & writer) != 0 || !this->state.compare_exchange_strong(state, state + 1))
+            return false;
+
+        stats.record(0);
+        return true;
+    }
+
+    void unlock_shared()
+    {
+        state.fetch_sub(1);
     }
 
+    const lock_stats_t<>& statistics() const { return stats; }
+
+private:
+    static constexpr uint32_t writer  = 0x80000000;
+    static constexpr uint32_t readers = ~writer;
+
+    atomic<uint32_t> state;
+    lock_stats_t<>   stats;
+};
+
+/// @brief std::lock_guard
+///
+template<typename Mutex>
+struct lock_guard
+{
+    explicit lock_guard(Mutex& mutex) : mutex(mutex) { mutex.lock(); }
+    ~lock_guard() { mutex.unlock(); }
+
+    lock_guard(const lock_guard&)            = delete;
+    lock_guard& operator=(const lock_guard&) = delete;
+
+private:
+    Mutex& mutex;
+};
+
+/// @brief std::shared_lock
+///
+template<typename Mutex>
+struct shared_lock
+{
+    explicit shared_lock(Mutex& mutex) : mutex(mutex) { mutex.lock_shared(); }
+    ~shared_lock() { mutex.unlock_shared(); }
+
+    shared_lock(const shared_lock&)            = delete;
+    shared_lock& operator=(const shared_lock&) = delete;
+
 private:
-    static constexpr auto max_wait = 65536;
-    volatile long _lock = 0;
+    Mutex& mutex;
 };
 };
@@ -0,0 +1,10 @@
+#pragma once
+#include <cstddef>
+
+/// Placement new, the kernel has no `<new>`.
+///
+#ifndef __PLACEMENT_NEW_INLINE
+#define __PLACEMENT_NEW_INLINE
+inline void* operator new(size_t, void* where) noexcept { return where; }
+inline void  operator delete(void*, void*) noexcept {}
+#endif
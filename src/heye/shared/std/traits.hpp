@@ -64,6 +64,14 @@ template<typename T> struct remove_reference<T&>  { typedef T type; };
 template<typename T> struct remove_reference<T&&> { typedef T type; };
 template<typename T> using  remove_reference_t = typename remove_reference<T>::type;
 
+/// @brief std::remove_cvref
+///
+template<typename T> struct remove_cv                   { typedef T type; };
+template<typename T> struct remove_cv<const T>          { typedef T type; };
+template<typename T> struct remove_cv<volatile T>       { typedef T type; };
+template<typename T> struct remove_cv<const volatile T> { typedef T type; };
+template<typename T> using  remove_cvref_t = typename remove_cv<remove_reference_t<T>>::type;
+
 /// @brief std::is_lvalue_reference
 ///
 template<typename T> struct is_lvalue_reference     : std::false_type {};
@@ -78,6 +86,11 @@ template<typename T>             struct is_same<T, T> : true_type  {};
 template<typename T, typename U>
 constexpr bool is_same_v = is_same<T, U>::value;
 
+/// @brief std::type_identity
+///
+template<typename T> struct type_identity { typedef T type; };
+template<typename T> using  type_identity_t = typename type_identity<T>::type;
+
 template<size_t N, typename T>
 constexpr auto countof(T(&)[N]) { return N; }
 
@@ -4,19 +4,19 @@
 namespace std
 {
 template <typename T>
-[[nodisard]] remove_reference_t<T>&& move(T&& arg) noexcept
+[[nodiscard]] remove_reference_t<T>&& move(T&& arg) noexcept
 {
   return static_cast<remove_reference_t<T>&&>(arg);
 }
 
 template <typename T>
-[[nodisard]] constexpr T&& forward(remove_reference_t<T>& arg) noexcept
+[[nodiscard]] constexpr T&& forward(remove_reference_t<T>& arg) noexcept
 {
     return static_cast<T&&>(arg);
 }
 
 template <class T>
-[[nodisard]] constexpr T&& forward(remove_reference_t<T>&& arg) noexcept
+[[nodiscard]] constexpr T&& forward(remove_reference_t<T>&& arg) noexcept
 {
     static_assert(!is_lvalue_reference_v<T>, "bad forward call");
     return static_cast<T&&>(arg);
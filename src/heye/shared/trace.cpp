@@ -1,21 +1,10 @@
 #include "heye/shared/cpu.hpp"
 #include "heye/shared/trace.hpp"
+#include "heye/platform/platform.hpp"
+#include "heye/config.hpp"
 
-#include <ntddk.h>
-#include <winmeta.h>
-#include <TraceLoggingProvider.h>
-
-#define _NO_CRT_STDIO_INLINE
 #include <cstdarg>
-#include <stdio.h>
-
-/// GUID: {60c3d354-edc4-4d20-8132-e16d9eeba96c}
-///
-TRACELOGGING_DECLARE_PROVIDER(provider);
-TRACELOGGING_DEFINE_PROVIDER(
-    provider, "HyperEyeProvider",
-    (0x60c3d354, 0xedc4, 0x4d20, 0x81, 0x32, 0xe1, 0x6d, 0x9e, 0xeb, 0xa9, 0x6c)
-);
+#include <intrin.h>
 
 namespace heye
 {
@@ -23,42 +12,444 @@ namespace detail
 {
 static bool initialized = false;
 
-void do_trace(const char* message)
+/// Record of `logger::root`. Sequence number tells the drainer whether the record was
+/// published, see `ring_t`.
+///
+struct trace_record_t
+{
+    volatile int64_t   sequence;
+    const char*        format;
+    uint64_t           timestamp;
+    uint32_t           id;
+    uint16_t           schema;
+    logger::level_t    level;
+    logger::category_t category;
+    uint64_t           args[logger::max_args];
+};
+static_assert(sizeof(trace_record_t) == 64, "Trace record must fill a cache line");
+
+/// Bounded ring of a single processor. Producers are root mode and everything that can
+/// interrupt the guest on that processor, so slots are reserved with a compare exchange
+/// and a record is published by bumping its sequence number. Only one drainer at a time.
+/// Records are slots of the ring rather than `slab_t` objects, since a slot is reused in
+/// place once drained and root mode never allocates or frees a record.
+///
+struct ring_t
 {
-    TraceLoggingWrite(
-        provider,
-        "MessageEvent",
-        TraceLoggingLevel(WINEVENT_LEVEL_INFO),
-        TraceLoggingValue(cpu::current(), "Core"),
-        TraceLoggingValue(message, "Message")
-   );
+    static constexpr int64_t mask = trace_ring_size - 1;
+    static_assert((trace_ring_size & mask) == 0, "Trace ring size must be a power of two");
+
+    trace_record_t   records[trace_ring_size];
+    volatile int64_t head;
+    volatile int64_t tail;
+    volatile int64_t dropped;
+    volatile long    draining;
+    int64_t          reported;
+};
+
+static ring_t* rings       = nullptr;
+static size_t  ring_count  = 0;
+
+/// TSC and performance counter values taken on setup, used to estimate TSC frequency.
+///
+static uint64_t setup_tsc  = 0;
+static int64_t  setup_qpc  = 0;
+
+volatile uint64_t log_mask = ~0ull;
+
+static void format(char* buffer, size_t size, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    platform::vformat(buffer, size, format, args);
+    va_end(args);
 }
+
+/// Pass published records of the ring to `fn` until it returns `false`. Record it refused
+/// stays in the ring. Returns `false` if another thread is draining the ring.
+///
+template<typename F>
+static bool consume(ring_t& ring, F&& fn)
+{
+    if (_InterlockedExchange(&ring.draining, 1) != 0)
+        return false;
+
+    for (;;)
+    {
+        auto& record = ring.records[ring.tail & ring_t::mask];
+        if (record.sequence != ring.tail + 1 || !fn(record))
+            break;
+        // Hand the slot back to producers.
+        //
+        _InterlockedExchange64(&record.sequence, ring.tail + ring_t::mask + 1);
+        ring.tail = ring.tail + 1;
+    }
+
+    _InterlockedExchange(&ring.draining, 0);
+    return true;
+}
+
+/// Take number of records dropped since the previous call.
+///
+static uint64_t take_dropped(ring_t& ring)
+{
+    const auto dropped = ring.dropped;
+    const auto count   = dropped - ring.reported;
+    ring.reported = dropped;
+    return static_cast<uint64_t>(count);
+}
+
+/// Estimate TSC frequency from the time elapsed since setup.
+///
+static uint64_t tsc_frequency()
+{
+    int64_t frequency{};
+    const auto qpc = platform::counter(&frequency) - setup_qpc;
+    const auto tsc = __rdtsc() - setup_tsc;
+    // Millisecond precision keeps the product in 64 bits for days of uptime.
+    //
+    const auto ticks_per_ms = static_cast<uint64_t>(frequency) / 1000;
+    if (qpc <= 0 || ticks_per_ms == 0)
+        return 0;
+    return tsc / (static_cast<uint64_t>(qpc) / ticks_per_ms + 1) * 1000;
+}
+
+/// Length of the string argument as stored in the binary stream.
+///
+static size_t string_length(uint64_t arg)
+{
+    const auto string = reinterpret_cast<const char*>(arg);
+    size_t length{};
+    while (string != nullptr && length < trace::max_string && string[length] != '\0')
+        length++;
+    return length;
+}
+
+/// Size of the event record in the binary stream. Lengths of string arguments are stored
+/// in `lengths`, so the writer doesn't scan the strings again.
+///
+static size_t event_size(const trace_record_t& record, size_t (&lengths)[logger::max_args])
+{
+    auto size = sizeof(trace::event_header_t);
+    for (uint32_t i = 0; i < trace::schema_count(record.schema); i++)
+    {
+        switch (trace::schema_arg(record.schema, i))
+        {
+        case trace::arg_t::i32:
+        case trace::arg_t::u32:
+            size += sizeof(uint32_t);
+            break;
+        case trace::arg_t::string:
+            lengths[i] = string_length(record.args[i]);
+            size      += 1 + lengths[i];
+            break;
+        default:
+            size += sizeof(uint64_t);
+            break;
+        }
+    }
+    return size;
+}
+
+/// Writer of a binary stream chunk. Remembers event ids defined in the chunk.
+///
+struct writer_t
+{
+    static constexpr auto max_defined = 64;
+
+    uint8_t* buffer;
+    size_t   size;
+    size_t   offset;
+    uint32_t defined[max_defined];
+    uint32_t defined_count;
+
+    bool fits(size_t length) const { return size - offset >= length; }
+
+    void put(const void* data, size_t length)
+    {
+        __movsb(buffer + offset, static_cast<const uint8_t*>(data), length);
+        offset += length;
+    }
+
+    bool is_defined(uint32_t id) const
+    {
+        for (uint32_t i = 0; i < defined_count; i++)
+        {
+            if (defined[i] == id)
+                return true;
+        }
+        return false;
+    }
+
+    /// Write the event, preceded by its definition if the chunk doesn't have one yet.
+    ///
+    bool event(uint16_t core, const trace_record_t& record)
+    {
+        const auto define = !is_defined(record.id);
+
+        size_t format_length{};
+        while (define && format_length < 0xffff && record.format[format_length] != '\0')
+            format_length++;
+
+        size_t lengths[logger::max_args]{};
+        const auto needed = event_size(record, lengths) + (define ? sizeof(trace::definition_header_t) + format_length : 0);
+        if (!fits(needed))
+            return false;
+
+        if (define)
+        {
+            const trace::definition_header_t definition
+            {
+                .kind     = trace::record_kind_t::definition,
+                .level    = record.level,
+                .length   = static_cast<uint16_t>(format_length),
+                .id       = record.id,
+                .schema   = record.schema,
+                .category = record.category,
+                .reserved = 0,
+            };
+            put(&definition, sizeof(definition));
+            put(record.format, format_length);
+            // Chunk that defines too many events just repeats some definitions.
+            //
+            if (defined_count < max_defined)
+                defined[defined_count++] = record.id;
+        }
+
+        const trace::event_header_t header
+        {
+            .kind      = trace::record_kind_t::event,
+            .reserved  = 0,
+            .core      = core,
+            .id        = record.id,
+            .timestamp = record.timestamp,
+        };
+        put(&header, sizeof(header));
+
+        for (uint32_t i = 0; i < trace::schema_count(record.schema); i++)
+        {
+            const auto arg = record.args[i];
+            switch (trace::schema_arg(record.schema, i))
+            {
+            case trace::arg_t::i32:
+            case trace::arg_t::u32:
+            {
+                const auto value = static_cast<uint32_t>(arg);
+                put(&value, sizeof(value));
+                break;
+            }
+            case trace::arg_t::string:
+            {
+                const auto string_size = static_cast<uint8_t>(lengths[i]);
+                put(&string_size, sizeof(string_size));
+                put(reinterpret_cast<const char*>(arg), string_size);
+                break;
+            }
+            default:
+                put(&arg, sizeof(arg));
+                break;
+            }
+        }
+        return true;
+    }
+};
 };
 
 bool logger::setup()
 {
-    if (NT_SUCCESS(TraceLoggingRegister(provider)))
+    if (detail::rings == nullptr)
+    {
+        detail::ring_count = cpu::count();
+        detail::rings      = new detail::ring_t[detail::ring_count];
+        if (detail::rings == nullptr)
+            return false;
+
+        for (size_t core = 0; core < detail::ring_count; core++)
+        {
+            for (int64_t i = 0; i < trace_ring_size; i++)
+            {
+                detail::rings[core].records[i].sequence = i;
+            }
+        }
+        detail::setup_tsc = __rdtsc();
+        detail::setup_qpc = platform::counter(nullptr);
+    }
+
+    if (platform::log_open())
         detail::initialized = true;
     return detail::initialized;
 }
 
 void logger::teardown()
 {
+    drain();
+
     if (detail::initialized)
-        TraceLoggingUnregister(provider);
+        platform::log_close();
     detail::initialized = false;
+
+    delete[] detail::rings;
+    detail::rings      = nullptr;
+    detail::ring_count = 0;
 }
 
-void logger::info(const char* format, ...)
+void detail::record(const char* format, uint32_t id, uint16_t schema, logger::level_t level, logger::category_t category, const uint64_t* args)
 {
-    if (detail::initialized)
+    const auto core = cpu::current();
+    if (rings == nullptr || core >= ring_count)
+        return;
+
+    auto& ring = rings[core];
+    auto  position = ring.head;
+
+    for (;;)
+    {
+        auto& record = ring.records[position & ring_t::mask];
+        const auto sequence = record.sequence;
+
+        if (sequence == position)
+        {
+            const auto current = _InterlockedCompareExchange64(&ring.head, position + 1, position);
+            if (current == position)
+            {
+                record.format    = format;
+                record.timestamp = __rdtsc();
+                record.id        = id;
+                record.schema    = schema;
+                record.level     = level;
+                record.category  = category;
+                for (uint32_t i = 0; i < logger::max_args; i++)
+                {
+                    record.args[i] = args[i];
+                }
+                // Publish record to the drainer.
+                //
+                _InterlockedExchange64(&record.sequence, position + 1);
+                return;
+            }
+            position = current;
+        }
+        else if (sequence < position)
+        {
+            // Slot wasn't drained yet, ring is full.
+            //
+            _InterlockedIncrement64(&ring.dropped);
+            return;
+        }
+        else
+        {
+            position = ring.head;
+        }
+    }
+}
+
+size_t logger::drain()
+{
+    if (detail::rings == nullptr)
+        return 0;
+
+    size_t emitted{};
+    char   message[512];
+
+    for (size_t core = 0; core < detail::ring_count; core++)
     {
-        va_list args;
-        va_start(args, format);
+        auto& ring = detail::rings[core];
+        const auto consumed = detail::consume(ring, [&](const detail::trace_record_t& record)
+        {
+            detail::format(message, sizeof(message), record.format, record.args[0], record.args[1], record.args[2], record.args[3]);
+            if (detail::initialized)
+                platform::log(record.level, record.category, core, record.timestamp, message);
+            emitted++;
+            return true;
+        });
 
-        char message[512];
-        vsprintf_s(message, sizeof(message), format, args);
-        detail::do_trace(message);
+        const auto dropped = consumed ? detail::take_dropped(ring) : 0;
+        if (dropped != 0 && detail::initialized)
+        {
+            detail::format(message, sizeof(message), "Dropped %llu trace records", dropped);
+            platform::log(logger::level_t::warn, logger::category_t::general, core, __rdtsc(), message);
+        }
     }
+    return emitted;
+}
+
+size_t logger::dump(void* buffer, size_t size)
+{
+    if (detail::rings == nullptr || size < sizeof(trace::stream_header_t))
+        return 0;
+
+    detail::writer_t writer{ static_cast<uint8_t*>(buffer), size, 0, {}, 0 };
+
+    const trace::stream_header_t header
+    {
+        .magic         = trace::magic,
+        .version       = trace::version,
+        .cores         = static_cast<uint16_t>(detail::ring_count),
+        .tsc_frequency = detail::tsc_frequency(),
+    };
+    writer.put(&header, sizeof(header));
+
+    for (size_t core = 0; core < detail::ring_count; core++)
+    {
+        auto& ring = detail::rings[core];
+        // Drop counter is only reset once it's in the chunk.
+        //
+        if (writer.fits(sizeof(trace::dropped_header_t)) && ring.dropped != ring.reported)
+        {
+            const trace::dropped_header_t dropped
+            {
+                .kind      = trace::record_kind_t::dropped,
+                .reserved  = 0,
+                .core      = static_cast<uint16_t>(core),
+                .reserved2 = 0,
+                .count     = detail::take_dropped(ring),
+            };
+            writer.put(&dropped, sizeof(dropped));
+        }
+
+        detail::consume(ring, [&](const detail::trace_record_t& record)
+        {
+            return writer.event(static_cast<uint16_t>(core), record);
+        });
+    }
+    return writer.offset;
+}
+
+uint64_t logger::dropped()
+{
+    uint64_t total{};
+    for (size_t core = 0; core < detail::ring_count; core++)
+    {
+        total += detail::rings[core].dropped;
+    }
+    return total;
+}
+
+void logger::enable(category_t category, level_t level)
+{
+    const auto shift = static_cast<uint64_t>(category) * 8;
+    const auto bits  = (0xffull << static_cast<uint64_t>(level)) & 0xff;
+    _InterlockedAnd64(reinterpret_cast<volatile int64_t*>(&detail::log_mask), ~static_cast<int64_t>(0xffull << shift));
+    _InterlockedOr64 (reinterpret_cast<volatile int64_t*>(&detail::log_mask),  static_cast<int64_t>(bits << shift));
+}
+
+void logger::disable(category_t category)
+{
+    const auto shift = static_cast<uint64_t>(category) * 8;
+    _InterlockedAnd64(reinterpret_cast<volatile int64_t*>(&detail::log_mask), ~static_cast<int64_t>(0xffull << shift));
+}
+
+void detail::emit(logger::level_t level, logger::category_t category, const char* format, ...)
+{
+    if (!initialized)
+        return;
+
+    va_list args;
+    va_start(args, format);
+
+    char message[512];
+    platform::vformat(message, sizeof(message), format, args);
+    va_end(args);
+    platform::log(level, category, cpu::current(), __rdtsc(), message);
 }
 };
@@ -1,9 +1,139 @@
 #pragma once
 #include "std/utility.hpp"
+#include "trace_format.hpp"
+#include "heye/config.hpp"
+
+#include <cstdint>
+#include <cstddef>
 
 namespace heye::logger
 {
+using level_t    = trace::level_t;
+using category_t = trace::category_t;
+
+/// Messages of the level and category are compiled in, see `log_level` and `log_categories`.
+///
+template<level_t level, category_t category>
+constexpr bool compiled_in = static_cast<uint32_t>(level) >= log_level
+                          && ((log_categories >> static_cast<uint32_t>(category)) & 1) != 0;
+};
+
+namespace heye::detail
+{
+/// Runtime filter, bit `category * 8 + level` enables the pair.
+///
+extern volatile uint64_t log_mask;
+
+template<logger::level_t level, logger::category_t category>
+inline bool enabled()
+{
+    constexpr auto bit = static_cast<uint32_t>(category) * 8 + static_cast<uint32_t>(level);
+    return ((log_mask >> bit) & 1) != 0;
+}
+
+template<typename T> inline uint64_t raw(T* value) { return reinterpret_cast<uint64_t>(value); }
+template<typename T> inline uint64_t raw(T  value) { return static_cast<uint64_t>(value); }
+
+void record(const char* format, uint32_t id, uint16_t schema, logger::level_t level, logger::category_t category, const uint64_t* args);
+
+void emit(logger::level_t level, logger::category_t category, const char* format, ...);
+
+/// Called at compile time on format errors, so they fail to compile.
+///
+void invalid_trace_format();
+};
+
+namespace heye::logger
+{
+/// Arguments stored by `root` per record.
+///
+static constexpr auto max_args = trace::max_args;
+
+/// Format string of `root` with event id and argument schema computed at compile time.
+/// Format must match the argument count and use only conversions `trace::schema_of` knows.
+///
+template<typename... Args>
+struct format_t
+{
+    template<size_t N>
+    consteval format_t(const char (&format)[N])
+        : text(format), id(trace::event_id(format)), schema(static_cast<uint16_t>(trace::schema_of(format)))
+    {
+        if (!trace::schema_valid(trace::schema_of(format)) || trace::schema_count(schema) != sizeof...(Args))
+            detail::invalid_trace_format();
+    }
+
+    const char* text;
+    uint32_t    id;
+    uint16_t    schema;
+};
+
 bool setup();
 void teardown();
-void info(const char* format, ...);
+
+/// Enable levels from `level` up of the category at runtime. Everything compiled in is enabled by default.
+///
+void enable(category_t category, level_t level);
+
+/// Disable every level of the category at runtime.
+///
+void disable(category_t category);
+
+/// Format and emit the message right away. Must not be called in vmx root, use `root` there.
+/// Disabled levels compile to nothing, enabled ones cost a single load when filtered at runtime.
+///
+template<level_t level, category_t category = category_t::general, typename... Args>
+void log(const char* format, Args... args)
+{
+    if constexpr (compiled_in<level, category>)
+    {
+        if (detail::enabled<level, category>())
+            detail::emit(level, category, format, args...);
+    }
+}
+
+template<category_t category = category_t::general, typename... Args>
+void debug(const char* format, Args... args) { log<level_t::debug, category>(format, args...); }
+
+template<category_t category = category_t::general, typename... Args>
+void info(const char* format, Args... args)  { log<level_t::info, category>(format, args...); }
+
+template<category_t category = category_t::general, typename... Args>
+void warn(const char* format, Args... args)  { log<level_t::warn, category>(format, args...); }
+
+template<category_t category = category_t::general, typename... Args>
+void error(const char* format, Args... args) { log<level_t::error, category>(format, args...); }
+
+/// Record message into the ring of the current processor without formatting it. Safe in
+/// vmx root and at any IRQL. Arguments are stored as raw 64-bit values, so the format may
+/// only use integer, pointer and string conversions, and strings must outlive the record.
+/// Filtered like `log`, so verbose levels can stay in hot exit handlers.
+///
+template<level_t level = level_t::info, category_t category = category_t::general, typename... Args>
+void root(format_t<std::type_identity_t<Args>...> format, Args... args)
+{
+    if constexpr (compiled_in<level, category>)
+    {
+        if (detail::enabled<level, category>())
+        {
+            const uint64_t values[max_args + 1] = { detail::raw(args)... };
+            detail::record(format.text, trace::site_id(format.id, level, category), format.schema, level, category, values);
+        }
+    }
+}
+
+/// Format and emit records logged with `root`. Must be called at passive level.
+/// Returns number of emitted records.
+///
+size_t drain();
+
+/// Move records logged with `root` into the buffer as a binary `trace::stream_header_t`
+/// chunk, which is several times smaller than formatted text. Must be called at passive
+/// level. Returns number of bytes written, records that don't fit stay in the rings.
+///
+size_t dump(void* buffer, size_t size);
+
+/// Total number of records dropped because the ring of their processor was full.
+///
+uint64_t dropped();
 };
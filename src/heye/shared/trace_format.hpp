@@ -0,0 +1,259 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/// Binary trace stream written by `logger::dump`. Has no platform dependencies, so the
+/// decoder can be built anywhere. Stream is a sequence of chunks, each one starts with
+/// `stream_header_t` followed by records. Every record starts with its `record_kind_t`.
+/// Multi-byte values are little endian.
+///
+namespace heye::trace
+{
+static constexpr uint32_t magic    = 0x54594548; // 'HEYT'
+static constexpr uint16_t version  = 2;
+/// Arguments per event.
+///
+static constexpr uint32_t max_args = 4;
+/// Longest string argument copied into the stream, longer ones are truncated.
+///
+static constexpr uint32_t max_string = 255;
+
+/// Severity of a message.
+///
+enum class level_t : uint8_t
+{
+    trace = 0,
+    debug = 1,
+    info  = 2,
+    warn  = 3,
+    error = 4
+};
+
+/// Subsystem a message comes from. At most 8 categories, see `logger::enable`.
+///
+enum class category_t : uint8_t
+{
+    general = 0,
+    hv      = 1,
+    vcpu    = 2,
+    ept     = 3,
+    exit    = 4,
+    mtrr    = 5
+};
+
+constexpr const char* level_name(level_t level)
+{
+    constexpr const char* names[] = { "trace", "debug", "info", "warn", "error" };
+    return static_cast<uint8_t>(level) < 5 ? names[static_cast<uint8_t>(level)] : "?";
+}
+
+constexpr const char* category_name(category_t category)
+{
+    constexpr const char* names[] = { "general", "hv", "vcpu", "ept", "exit", "mtrr" };
+    return static_cast<uint8_t>(category) < 6 ? names[static_cast<uint8_t>(category)] : "?";
+}
+
+/// Argument encoding derived from the format string conversion.
+///
+enum class arg_t : uint8_t
+{
+    none     = 0,
+    i32      = 1,
+    u32      = 2,
+    i64      = 3,
+    u64      = 4,
+    pointer  = 5,
+    /// Length byte followed by characters without terminator.
+    ///
+    string   = 6,
+    invalid  = 15
+};
+
+enum class record_kind_t : uint8_t
+{
+    event      = 1,
+    definition = 2,
+    dropped    = 3
+};
+
+#pragma pack(push, 1)
+struct stream_header_t
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t cores;
+    /// Estimated TSC frequency in Hz or 0 if unknown.
+    ///
+    uint64_t tsc_frequency;
+};
+static_assert(sizeof(stream_header_t) == 16);
+
+/// Event followed by its arguments encoded as stated by the schema.
+///
+struct event_header_t
+{
+    record_kind_t kind;
+    uint8_t       reserved;
+    uint16_t      core;
+    uint32_t      id;
+    uint64_t      timestamp;
+};
+static_assert(sizeof(event_header_t) == 16);
+
+/// Format string, level and category of the event id followed by `length` characters.
+/// Precedes the first event with the id in every chunk.
+///
+struct definition_header_t
+{
+    record_kind_t kind;
+    level_t       level;
+    uint16_t      length;
+    uint32_t      id;
+    uint16_t      schema;
+    category_t    category;
+    uint8_t       reserved;
+};
+static_assert(sizeof(definition_header_t) == 12);
+
+/// Number of events the core dropped since the previous chunk.
+///
+struct dropped_header_t
+{
+    record_kind_t kind;
+    uint8_t       reserved;
+    uint16_t      core;
+    uint32_t      reserved2;
+    uint64_t      count;
+};
+static_assert(sizeof(dropped_header_t) == 16);
+#pragma pack(pop)
+
+/// Event id is FNV-1a hash of the format string.
+///
+constexpr uint32_t event_id(const char* format)
+{
+    uint32_t hash = 0x811c9dc5;
+    for (; *format != '\0'; format++)
+    {
+        hash ^= static_cast<uint8_t>(*format);
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+/// Id of a call site, the same format may be logged with different levels and categories.
+///
+constexpr uint32_t site_id(uint32_t format_id, level_t level, category_t category)
+{
+    return (format_id ^ (static_cast<uint32_t>(level) | static_cast<uint32_t>(category) << 8)) * 0x01000193;
+}
+
+/// Argument types packed by 4 bits, first argument in the lowest bits.
+///
+constexpr uint32_t schema_count(uint32_t schema)
+{
+    uint32_t count = 0;
+    while (count < 8 && ((schema >> (count * 4)) & 0xf) != 0)
+    {
+        count++;
+    }
+    return count;
+}
+
+constexpr arg_t schema_arg(uint32_t schema, uint32_t index)
+{
+    return static_cast<arg_t>((schema >> (index * 4)) & 0xf);
+}
+
+/// Build schema of the printf format string. Follows Windows sizes: `l` is 32-bit, while
+/// `ll`, `I64`, `z`, `j` and `t` are 64-bit. Conversions that can't be stored as raw
+/// 64-bit values (floating point, `*` width, `%n`) make the schema invalid.
+///
+constexpr uint32_t schema_of(const char* format)
+{
+    uint32_t schema = 0;
+    uint32_t count  = 0;
+
+    for (; *format != '\0'; format++)
+    {
+        if (*format != '%')
+            continue;
+
+        format++;
+        if (*format == '%')
+            continue;
+
+        // Flags, width and precision.
+        //
+        while (*format == '-' || *format == '+' || *format == ' ' || *format == '#' || *format == '0')
+            format++;
+        while (*format == '.' || (*format >= '0' && *format <= '9'))
+            format++;
+        if (*format == '*')
+            return static_cast<uint32_t>(arg_t::invalid);
+        // Length modifier.
+        //
+        auto wide = false;
+        if (format[0] == 'l' && format[1] == 'l')
+        {
+            wide = true;
+            format += 2;
+        }
+        else if (format[0] == 'I' && format[1] == '6' && format[2] == '4')
+        {
+            wide = true;
+            format += 3;
+        }
+        else if (format[0] == 'I' && format[1] == '3' && format[2] == '2')
+        {
+            format += 3;
+        }
+        else if (*format == 'z' || *format == 'j' || *format == 't' || *format == 'I')
+        {
+            wide = true;
+            format++;
+        }
+        else
+        {
+            while (*format == 'h' || *format == 'l')
+                format++;
+        }
+
+        auto type = arg_t::invalid;
+        switch (*format)
+        {
+        case 'd': case 'i':
+            type = wide ? arg_t::i64 : arg_t::i32;
+            break;
+        case 'u': case 'x': case 'X': case 'o': case 'c':
+            type = wide ? arg_t::u64 : arg_t::u32;
+            break;
+        case 'p':
+            type = arg_t::pointer;
+            break;
+        case 's':
+            type = arg_t::string;
+            break;
+        default:
+            break;
+        }
+
+        if (type == arg_t::invalid || count == max_args)
+            return static_cast<uint32_t>(arg_t::invalid);
+
+        schema |= static_cast<uint32_t>(type) << (count++ * 4);
+    }
+    return schema;
+}
+
+constexpr bool schema_valid(uint32_t schema)
+{
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        if (schema_arg(schema, i) == arg_t::invalid)
+            return false;
+    }
+    return true;
+}
+};
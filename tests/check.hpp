@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdio>
+
+/// Number of failed checks of the test executable.
+///
+inline int failures;
+
+#define CHECK(expression)                                                           \
+    do                                                                              \
+    {                                                                               \
+        if (!(expression))                                                          \
+        {                                                                           \
+            std::printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expression);     \
+            failures++;                                                             \
+        }                                                                           \
+    } while (false)
+
+/// Exit code of the test executable.
+///
+inline int report()
+{
+    if (failures != 0)
+        std::printf("%d checks failed\n", failures);
+    return failures != 0 ? 1 : 0;
+}
@@ -0,0 +1,319 @@
+#include "heye/arch/msr.hpp"
+#include "heye/hv/ept.hpp"
+#include "heye/hv/slab.hpp"
+#include "heye/hv/violation.hpp"
+#include "heye/platform/platform.hpp"
+#include "heye/platform/simulation/machine.hpp"
+#include "heye/shared/trace.hpp"
+
+#include "check.hpp"
+
+using namespace heye;
+
+/// Four processors with 2GB of RAM below 4GB and one gigabyte at 6GB.
+///
+static void setup_machine(bool large_pages)
+{
+    simulation::reset(4);
+    simulation::add_physical_range(0x1000, 2_gb - 0x1000);
+    simulation::add_physical_range(6_gb, 1_gb);
+
+    msr::vmx_ept_vpid_cap cap{};
+    cap.rwx_x_only       = true;
+    cap.memory_type_wb   = true;
+    cap.pde_1g           = large_pages;
+    cap.ept_access_dirty = true;
+    simulation::set_msr(msr::vmx_ept_vpid_cap::id, cap.flags);
+    // 39 physical address bits.
+    //
+    simulation::set_cpuid(0x80000008, 0, 39, 0, 0, 0);
+}
+
+static void test_ept_split_merge()
+{
+    setup_machine(true);
+
+    table_pool_t pool;
+    ept_t ept(&pool);
+    CHECK(pool);
+    CHECK(ept);
+    CHECK(ept.mapped() == 5);
+    CHECK(ept.large_pages() == 5);
+
+    const uint64_t pa = 1_gb + 2_mb + 0x1000;
+    const auto available = pool.available();
+
+    // 1GB page is split into 2MB pages, then the 2MB page into 4KB pages.
+    //
+    auto entry = ept.split(pa);
+    CHECK(entry != nullptr);
+    CHECK(ept.pte(pa) == entry);
+    CHECK(entry->pfn == pa >> page_shift);
+    CHECK(ept.pte(pa + page_size)->pfn == (pa >> page_shift) + 1);
+    CHECK(ept.pte(pa + 2_mb) == nullptr);
+    CHECK(pool.available() == available - 2);
+    CHECK(ept.split(pa) == entry);
+
+    // Modified entry keeps the table split.
+    //
+    entry->write = false;
+    CHECK(!ept.merge(pa));
+    entry->write = true;
+
+    // Table is retired and only returns to the pool once sealed and reclaimed.
+    //
+    CHECK(ept.merge(pa));
+    CHECK(ept.pte(pa) == nullptr);
+    CHECK(pool.available() == available - 2);
+    pool.seal();
+    pool.reclaim();
+    CHECK(pool.available() == available - 1);
+
+    // Gigabytes outside of the memory map are mapped on demand.
+    //
+    CHECK(ept.map(9_gb + 0x1000));
+    CHECK(ept.mapped() == 6);
+    CHECK(!ept.map(1ull << 39));
+
+    ept.invalidate();
+    CHECK(simulation::invepts(0) == 1);
+}
+
+static void test_ept_populate()
+{
+    setup_machine(false);
+
+    table_pool_t pool;
+    ept_t ept(&pool);
+    CHECK(ept);
+    CHECK(ept.mapped() == 5);
+    CHECK(ept.large_pages() == 0);
+
+    // Page directories filled by every processor map write back 2MB pages.
+    //
+    const uint64_t pa = 6_gb + 511 * 2_mb;
+    CHECK(ept.pte(pa) == nullptr);
+    auto entry = ept.split(pa);
+    CHECK(entry != nullptr);
+    CHECK(entry->pfn == pa >> page_shift);
+    CHECK(entry->read && entry->write && entry->execute);
+    CHECK(entry->memory_type == static_cast<uint64_t>(memory_type_t::write_back));
+}
+
+static void test_ept_access()
+{
+    setup_machine(true);
+
+    table_pool_t pool;
+    ept_t ept(&pool);
+
+    const uint64_t pa = 1_gb + 0x5000;
+    auto entry = ept.split(pa);
+    CHECK(entry != nullptr);
+    CHECK(ept.clear(pa, access_bit_t::dirty) == page_size);
+    CHECK(ept.clear(pa + 4_mb, access_bit_t::dirty) == 2_mb);
+    CHECK(ept.clear(6_gb, access_bit_t::dirty) == 1_gb);
+    CHECK(ept.clear(10_gb, access_bit_t::dirty) == 0);
+
+    static uint64_t bits[(1ull << 30) / page_size / 64];
+    frame_bitmap_t bitmap{ 1_gb, 1_gb / page_size, bits };
+
+    entry->dirty = true;
+    CHECK(ept.harvest(bitmap, access_bit_t::dirty) == 1);
+    CHECK(bitmap.test(pa));
+    CHECK(!bitmap.test(pa + page_size));
+    CHECK(!entry->dirty);
+    // Flags are cleared, so the next harvest finds nothing.
+    //
+    CHECK(ept.harvest(bitmap, access_bit_t::dirty) == 0);
+}
+
+static void test_ept_views()
+{
+    setup_machine(true);
+
+    table_pool_t pool;
+    ept_t ept(&pool);
+
+    const uint64_t pa = 2_gb + 0x3000;
+    const auto global = ept.split(pa);
+    CHECK(global != nullptr);
+
+    const auto available = pool.available();
+    {
+        ept_t view(&ept);
+        CHECK(view);
+        CHECK(view.is_view());
+        // Tables are shared until the view modifies them.
+        //
+        CHECK(view.pte(pa) == global);
+
+        auto own = view.split(pa);
+        CHECK(own != nullptr);
+        CHECK(own != global);
+        CHECK(own->pfn == global->pfn);
+        CHECK(view.pte(pa + page_size) != ept.pte(pa + page_size));
+        CHECK(pool.available() < available);
+
+        // Root never merges while views might share the table.
+        //
+        CHECK(!ept.merge(pa));
+
+        // Gigabyte mapped on demand reaches the view that copied the PDPT of its region.
+        //
+        CHECK(view.split(0x3000) != nullptr);
+        CHECK(view.map(9_gb));
+        CHECK(ept.clear(9_gb, access_bit_t::dirty) != 0);
+        CHECK(view.clear(9_gb, access_bit_t::dirty) == ept.clear(9_gb, access_bit_t::dirty));
+        CHECK(view.mapped() == ept.mapped());
+    }
+    CHECK(pool.available() == available);
+    CHECK(ept.merge(pa));
+}
+
+static bool handle(vcpu_t*, const ept_violation_t&, void*)
+{
+    return true;
+}
+
+static void test_violations()
+{
+    auto table = new violation_table_t;
+    ept_handler_t first { handle, nullptr };
+    ept_handler_t second{ handle, nullptr };
+
+    CHECK(table->insert(0x10000, 4 * page_size, &first));
+    CHECK(table->count() == 4);
+    CHECK(table->find(0x12345) == &first);
+    CHECK(table->find(0x14000) == nullptr);
+    // Overlapping range is rejected as a whole.
+    //
+    CHECK(!table->insert(0x13000, 2 * page_size, &second));
+    CHECK(table->find(0x14000) == nullptr);
+    CHECK(table->count() == 4);
+
+    table->remove(0x11000, page_size);
+    CHECK(table->find(0x11000) == nullptr);
+    CHECK(table->find(0x12000) == &first);
+    CHECK(table->insert(0x11000, page_size, &second));
+    CHECK(table->find(0x11000) == &second);
+    table->remove(0x10000, 4 * page_size);
+    CHECK(table->count() == 0);
+
+    // Removed slots are reused, so churn never fills the table.
+    //
+    for (uint64_t round = 0; round < 8; round++)
+    {
+        const auto base = round * violation_table_t::capacity * page_size;
+        CHECK(table->insert(base, violation_table_t::capacity / 2 * page_size, &first));
+        table->remove(base, violation_table_t::capacity / 2 * page_size);
+    }
+    CHECK(table->count() == 0);
+    delete table;
+}
+
+static void test_slab()
+{
+    simulation::reset(4);
+
+    slab_t slab(48, 100);
+    CHECK(slab);
+
+    void* objects[100];
+    for (auto& object : objects)
+    {
+        object = slab.allocate();
+        CHECK(object != nullptr);
+        CHECK(slab.contains(object));
+        CHECK(reinterpret_cast<uintptr_t>(object) % 16 == 0);
+    }
+    CHECK(slab.allocate() == nullptr);
+
+    // Objects freed on one processor are taken on another through the shared list,
+    // except for those that stay in the cache of the freeing processor.
+    //
+    simulation::set_current(1);
+    for (auto object : objects)
+    {
+        slab.free(object);
+    }
+    simulation::set_current(2);
+    for (uint64_t i = 0; i < 100 - slab_cache_size; i++)
+    {
+        objects[i] = slab.allocate();
+        CHECK(objects[i] != nullptr);
+    }
+    for (uint64_t i = 0; i < 100 - slab_cache_size; i++)
+    {
+        slab.free(objects[i]);
+    }
+    simulation::set_current(0);
+
+    const auto usage = slab.usage();
+    CHECK(usage.capacity == 100);
+    CHECK(usage.used     == 0);
+    CHECK(usage.peak     == 100);
+    CHECK(usage.failures == 1);
+
+    slab_t pages(page_size, 4, page_size);
+    auto page = pages.allocate();
+    CHECK(page != nullptr);
+    CHECK(reinterpret_cast<uintptr_t>(page) % page_size == 0);
+    pages.free(page);
+}
+
+static void test_trace()
+{
+    simulation::reset(2);
+    CHECK(logger::setup());
+
+    for (uint64_t i = 0; i < 8; i++)
+    {
+        logger::root<logger::level_t::error>("Record %lld", i);
+    }
+    CHECK(logger::drain() == 8);
+
+    // Full ring drops records instead of blocking root mode.
+    //
+    const auto dropped = logger::dropped();
+    for (uint64_t i = 0; i < trace_ring_size + 3; i++)
+    {
+        logger::root<logger::level_t::error>("Record %lld", i);
+    }
+    CHECK(logger::dropped() == dropped + 3);
+    logger::teardown();
+}
+
+static void test_kick()
+{
+    simulation::reset(4);
+    simulation::set_current(1);
+
+    uint64_t target = ~0ull;
+    auto kicks = platform::create_kicks([](void* context)
+    {
+        *static_cast<uint64_t*>(context) = platform::current_processor();
+    }, &target);
+    CHECK(kicks != nullptr);
+
+    // Shootdown kicks run on the lagging processor, not the caller.
+    //
+    platform::kick(kicks, 3);
+    CHECK(target == 3);
+    CHECK(platform::current_processor() == 1);
+    platform::destroy_kicks(kicks);
+    simulation::set_current(0);
+}
+
+int main()
+{
+    test_ept_split_merge();
+    test_ept_populate();
+    test_ept_access();
+    test_ept_views();
+    test_violations();
+    test_slab();
+    test_trace();
+    test_kick();
+    return report();
+}
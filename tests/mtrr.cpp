@@ -0,0 +1,130 @@
+#include "heye/arch/msr.hpp"
+#include "heye/arch/mtrr.hpp"
+#include "heye/hv/ept.hpp"
+#include "heye/platform/simulation/machine.hpp"
+
+#include "check.hpp"
+
+using namespace heye;
+
+static constexpr auto uc = memory_type_t::uncachable;
+static constexpr auto wt = memory_type_t::write_through;
+static constexpr auto wb = memory_type_t::write_back;
+
+/// Program variable range MTRR `index` with a naturally aligned power of two range.
+///
+static void set_variable(uint32_t index, uint64_t base, uint64_t size, memory_type_t type)
+{
+    msr::mtrr_physbase physbase{};
+    physbase.type = static_cast<uint64_t>(type);
+    physbase.pfn  = base >> page_shift;
+
+    msr::mtrr_physmask physmask{};
+    physmask.valid = true;
+    physmask.pfn   = ~((size >> page_shift) - 1);
+
+    simulation::set_msr(msr::mtrr_physbase::id + index * 2, physbase.flags);
+    simulation::set_msr(msr::mtrr_physmask::id + index * 2, physmask.flags);
+}
+
+/// Two processors with 3GB of RAM, uncachable default type and these ranges:
+/// - first 64KB are write through in the fixed range MTRRs, the rest of the first
+///   512KB is write back and the first megabyte is uncachable in a variable MTRR
+/// - first 2GB are write back
+/// - 2MB at 1GB are uncachable, 2MB at 1GB + 4MB are write through
+///
+static void setup_machine()
+{
+    simulation::reset(2);
+    simulation::add_physical_range(0x1000, 3_gb - 0x1000);
+
+    msr::vmx_ept_vpid_cap cap{};
+    cap.rwx_x_only     = true;
+    cap.memory_type_wb = true;
+    cap.pde_1g         = true;
+    simulation::set_msr(msr::vmx_ept_vpid_cap::id, cap.flags);
+    simulation::set_cpuid(0x80000008, 0, 39, 0, 0, 0);
+
+    msr::mtrrcap mtrrcap{};
+    mtrrcap.vnct = 4;
+    mtrrcap.fix  = true;
+    simulation::set_msr(msr::mtrrcap::id, mtrrcap.flags);
+
+    msr::mtrr_def_type def_type{};
+    def_type.memory_type             = static_cast<uint64_t>(uc);
+    def_type.fixed_range_mtrr_enable = true;
+    def_type.mtrr_enable             = true;
+    simulation::set_msr(msr::mtrr_def_type::id, def_type.flags);
+
+    simulation::set_msr(msr::mtrr_fix_64k::id, 0x0606060606060604);
+
+    set_variable(0, 0,             2_gb, wb);
+    set_variable(1, 0,             1_mb, uc);
+    set_variable(2, 1_gb,          2_mb, uc);
+    set_variable(3, 1_gb + 4_mb,   2_mb, wt);
+}
+
+static void test_precedence()
+{
+    setup_machine();
+
+    auto mtrr = new mtrr_descriptor;
+    CHECK(mtrr->default_type() == uc);
+
+    // Fixed ranges win over variable ranges in the first megabyte.
+    //
+    CHECK(mtrr->get_range_type_or(0,       64_kb, mtrr->default_type()).type == wt);
+    CHECK(mtrr->get_range_type_or(0x10000, 64_kb, mtrr->default_type()).type == wb);
+
+    // UC wins and WT takes precedence over WB where variable ranges overlap.
+    //
+    CHECK(mtrr->get_type_or(1_gb,        mtrr->default_type()) == uc);
+    CHECK(mtrr->get_type_or(1_gb + 4_mb, mtrr->default_type()) == wt);
+    CHECK(mtrr->get_type_or(1_gb + 8_mb, mtrr->default_type()) == wb);
+
+    // Mixed ranges report the strongest type and aren't uniform.
+    //
+    const auto uniform = mtrr->get_range_type_or(1_gb + 8_mb, 8_mb, mtrr->default_type());
+    CHECK(uniform.type == wb && uniform.uniform);
+    const auto mixed = mtrr->get_range_type_or(1_gb + 2_mb, 4_mb, mtrr->default_type());
+    CHECK(mixed.type == wt && !mixed.uniform);
+    const auto strongest = mtrr->get_range_type_or(1_gb, 1_gb, mtrr->default_type());
+    CHECK(strongest.type == uc && !strongest.uniform);
+
+    // Addresses outside of every range get the default type.
+    //
+    const auto gap = mtrr->get_range_type_or(2_gb, 1_gb, mtrr->default_type());
+    CHECK(gap.type == uc && gap.uniform);
+    const auto edge = mtrr->get_range_type_or(2_gb - 2_mb, 4_mb, mtrr->default_type());
+    CHECK(edge.type == uc && !edge.uniform);
+    delete mtrr;
+}
+
+static void test_ept_memory_types()
+{
+    setup_machine();
+
+    table_pool_t pool;
+    ept_t ept(&pool);
+    CHECK(ept);
+
+    // Gigabyte not covered by any MTRR is mapped with the default type.
+    //
+    const auto gap = ept.split(2_gb + 0x1000);
+    CHECK(gap != nullptr);
+    CHECK(gap != nullptr && gap->memory_type == static_cast<uint64_t>(uc));
+
+    const auto written = ept.split(1_gb + 8_mb);
+    CHECK(written != nullptr && written->memory_type == static_cast<uint64_t>(wb));
+    const auto through = ept.split(1_gb + 4_mb);
+    CHECK(through != nullptr && through->memory_type == static_cast<uint64_t>(wt));
+    const auto uncached = ept.split(1_gb);
+    CHECK(uncached != nullptr && uncached->memory_type == static_cast<uint64_t>(uc));
+}
+
+int main()
+{
+    test_precedence();
+    test_ept_memory_types();
+    return report();
+}
@@ -0,0 +1,104 @@
+#include "heye/shared/stats.hpp"
+
+#include "check.hpp"
+
+using namespace heye;
+
+static_assert(alignof(stats::histogram_t) == 64);
+static_assert(alignof(stats::exit_stats_t) == 64);
+
+static void test_bucket()
+{
+    CHECK(stats::bucket(0) == 0);
+    CHECK(stats::bucket(1) == 0);
+    CHECK(stats::bucket(2) == 1);
+    CHECK(stats::bucket(3) == 1);
+    CHECK(stats::bucket(4) == 2);
+    CHECK(stats::bucket(1023) == 9);
+    CHECK(stats::bucket(1024) == 10);
+    // Last bucket also counts everything longer.
+    //
+    CHECK(stats::bucket(1ull << (stats::buckets - 1)) == stats::buckets - 1);
+    CHECK(stats::bucket(~0ull) == stats::buckets - 1);
+}
+
+static void test_percentile()
+{
+    stats::histogram_t histogram{};
+    CHECK(histogram.percentile(50) == 0);
+    CHECK(histogram.mean() == 0);
+
+    for (int i = 0; i < 90; i++)
+        histogram.record(10);
+    for (int i = 0; i < 10; i++)
+        histogram.record(1000);
+
+    CHECK(histogram.count == 100);
+    CHECK(histogram.mean() == 109);
+    CHECK(histogram.max == 1000);
+    // Upper bound of [8, 16) and [512, 1024).
+    //
+    CHECK(histogram.percentile(1)   == 15);
+    CHECK(histogram.percentile(90)  == 15);
+    CHECK(histogram.percentile(91)  == 1023);
+    CHECK(histogram.percentile(100) == 1023);
+    CHECK(histogram.percentile(200) == 1023);
+
+    // Samples of the last bucket have no upper bound, so the maximum is reported.
+    //
+    histogram.record(1ull << 40);
+    CHECK(histogram.percentile(100) == 1ull << 40);
+}
+
+static void test_merge()
+{
+    stats::histogram_t a{};
+    stats::histogram_t b{};
+    a.record(4);
+    a.record(100);
+    b.record(7);
+    b.record(5000);
+
+    a.merge(b);
+    CHECK(a.count  == 4);
+    CHECK(a.cycles == 4 + 100 + 7 + 5000);
+    CHECK(a.max    == 5000);
+    CHECK(a.samples[stats::bucket(4)] == 2);
+    CHECK(a.samples[stats::bucket(5000)] == 1);
+
+    // Merging empty histogram changes nothing.
+    //
+    a.merge(stats::histogram_t{});
+    CHECK(a.count == 4);
+    CHECK(a.max   == 5000);
+}
+
+static void test_aggregate()
+{
+    static stats::exit_stats_t vcpus[3];
+    static stats::exit_stats_t total;
+
+    vcpus[0].record(vmx::exit_reason::cpuid, 100);
+    vcpus[1].record(vmx::exit_reason::cpuid, 300);
+    vcpus[1].record(vmx::exit_reason::ept_violation, 2000);
+    vcpus[2].record(vmx::exit_reason::vmcall, 50);
+    // Out of range reasons are dropped.
+    //
+    vcpus[2].record(vmx::exit_reason::max, 1);
+
+    stats::aggregate(vcpus, 3, total);
+    CHECK(total.count()  == 4);
+    CHECK(total.cycles() == 100 + 300 + 2000 + 50);
+    CHECK(total.hottest() == vmx::exit_reason::ept_violation);
+    CHECK(total.reason[static_cast<size_t>(vmx::exit_reason::cpuid)].count == 2);
+    CHECK(total.reason[static_cast<size_t>(vmx::exit_reason::cpuid)].max   == 300);
+}
+
+int main()
+{
+    test_bucket();
+    test_percentile();
+    test_merge();
+    test_aggregate();
+    return report();
+}
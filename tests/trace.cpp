@@ -0,0 +1,62 @@
+#include "trace_writer.hpp"
+
+#include "decoder.hpp"
+#include "check.hpp"
+
+#include <string>
+
+using namespace heye;
+
+static uint8_t buffer[0x10000];
+
+/// Records logged in root mode are dumped into a binary chunk and decoded back.
+///
+static void test_round_trip()
+{
+    const auto size = trace_writer::write(buffer, sizeof(buffer));
+    CHECK(size > sizeof(trace::stream_header_t));
+
+    trace::decoder_t decoder;
+    CHECK(decoder.feed(buffer, size));
+    CHECK(decoder.error.empty());
+    CHECK(decoder.cores == 2);
+    CHECK(decoder.events.size() == 3);
+    // Both records of the same site share one definition.
+    //
+    CHECK(decoder.definitions.size() == 2);
+
+    if (decoder.events.size() == 3)
+    {
+        const auto& exit = decoder.events[0];
+        CHECK(exit.core == 0);
+        CHECK(decoder.message(exit) == "Exit 48");
+
+        const auto& first = decoder.events[1];
+        CHECK(first.core == 1);
+        CHECK(first.args.size() == 3);
+        CHECK(decoder.message(first) == "Core -5 mapped 123456789 with views");
+
+        const auto definition = decoder.definition(first.id);
+        CHECK(definition != nullptr);
+        CHECK(definition != nullptr && definition->level    == trace::level_t::error);
+        CHECK(definition != nullptr && definition->category == trace::category_t::ept);
+
+        // Long strings are truncated in the stream.
+        //
+        const auto& second = decoder.events[2];
+        CHECK(second.id == first.id);
+        CHECK(second.args.size() == 3 && second.args[2].string == std::string(trace::max_string, 'x'));
+    }
+
+    // Dumped records leave the rings.
+    //
+    trace::decoder_t empty;
+    CHECK(empty.feed(buffer, trace_writer::finish(buffer, sizeof(buffer))));
+    CHECK(empty.events.empty());
+}
+
+int main()
+{
+    test_round_trip();
+    return report();
+}
@@ -0,0 +1,36 @@
+#include "trace_writer.hpp"
+
+#include "heye/platform/simulation/machine.hpp"
+#include "heye/shared/trace.hpp"
+
+#include "check.hpp"
+
+using namespace heye;
+
+static char long_string[trace_writer::long_length + 1];
+
+size_t trace_writer::write(uint8_t* buffer, size_t size)
+{
+    simulation::reset(2);
+    CHECK(logger::setup());
+
+    for (size_t i = 0; i < long_length; i++)
+    {
+        long_string[i] = 'x';
+    }
+
+    simulation::set_current(1);
+    logger::root<logger::level_t::error, logger::category_t::ept>("Core %d mapped %llx with %s", -5, 0x123456789ull, "views");
+    logger::root<logger::level_t::error, logger::category_t::ept>("Core %d mapped %llx with %s", 3, 0x1000ull, static_cast<const char*>(long_string));
+    simulation::set_current(0);
+    logger::root<logger::level_t::warn, logger::category_t::hv>("Exit %u", 48u);
+
+    return logger::dump(buffer, size);
+}
+
+size_t trace_writer::finish(uint8_t* buffer, size_t size)
+{
+    const auto written = logger::dump(buffer, size);
+    logger::teardown();
+    return written;
+}
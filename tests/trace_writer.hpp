@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/// Records of the trace round trip test, written with the driver's logger. Kept apart from
+/// the decoder, since the driver's `std` replacements can't share a translation unit with
+/// the host standard library.
+///
+namespace trace_writer
+{
+/// Characters of the string argument that exceeds `trace::max_string`.
+///
+static constexpr size_t long_length = 300;
+
+/// Log the test records in root mode and dump them into the buffer.
+/// Returns number of bytes written.
+///
+size_t write(uint8_t* buffer, size_t size);
+
+/// Dump whatever is left in the rings and tear the logger down.
+///
+size_t finish(uint8_t* buffer, size_t size);
+};
@@ -0,0 +1,312 @@
+#include "decoder.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+namespace heye::trace
+{
+/// Bounds checked reader of the input buffer.
+///
+struct reader_t
+{
+    const uint8_t* data;
+    size_t         size;
+    size_t         offset;
+
+    bool remains(size_t length) const { return size - offset >= length; }
+
+    template<typename T>
+    bool get(T& value)
+    {
+        if (!remains(sizeof(T)))
+            return false;
+        std::memcpy(&value, data + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    bool get(std::string& value, size_t length)
+    {
+        if (!remains(length))
+            return false;
+        value.assign(reinterpret_cast<const char*>(data + offset), length);
+        offset += length;
+        return true;
+    }
+};
+
+static bool read_args(reader_t& reader, uint32_t schema, std::vector<arg_value_t>& args)
+{
+    for (uint32_t i = 0; i < schema_count(schema); i++)
+    {
+        arg_value_t arg{ schema_arg(schema, i), 0, {} };
+        switch (arg.type)
+        {
+        case arg_t::i32:
+        case arg_t::u32:
+        {
+            uint32_t value{};
+            if (!reader.get(value))
+                return false;
+            arg.value = arg.type == arg_t::i32 ? static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(value))) : value;
+            break;
+        }
+        case arg_t::string:
+        {
+            uint8_t length{};
+            if (!reader.get(length) || !reader.get(arg.string, length))
+                return false;
+            break;
+        }
+        case arg_t::i64:
+        case arg_t::u64:
+        case arg_t::pointer:
+            if (!reader.get(arg.value))
+                return false;
+            break;
+        default:
+            return false;
+        }
+        args.push_back(std::move(arg));
+    }
+    return true;
+}
+
+bool decoder_t::feed(const uint8_t* data, size_t size)
+{
+    reader_t reader{ data, size, 0 };
+    auto in_chunk = false;
+
+    while (reader.remains(1))
+    {
+        // Chunk header is recognized by its magic, records never start with it.
+        //
+        uint32_t magic_value{};
+        if (reader.remains(sizeof(stream_header_t)))
+        {
+            std::memcpy(&magic_value, data + reader.offset, sizeof(magic_value));
+        }
+        if (magic_value == magic)
+        {
+            stream_header_t header{};
+            reader.get(header);
+            if (header.version != version)
+            {
+                error = "unsupported stream version " + std::to_string(header.version);
+                return false;
+            }
+            cores         = std::max(cores, header.cores);
+            tsc_frequency = header.tsc_frequency != 0 ? header.tsc_frequency : tsc_frequency;
+            in_chunk      = true;
+            continue;
+        }
+
+        if (!in_chunk)
+        {
+            error = "stream doesn't start with a chunk header";
+            return false;
+        }
+
+        const auto kind = static_cast<record_kind_t>(data[reader.offset]);
+        switch (kind)
+        {
+        case record_kind_t::definition:
+        {
+            definition_header_t header{};
+            definition_t definition{};
+            if (!reader.get(header) || !reader.get(definition.format, header.length))
+            {
+                error = "truncated definition";
+                return false;
+            }
+            definition.id       = header.id;
+            definition.schema   = header.schema;
+            definition.level    = header.level;
+            definition.category = header.category;
+            definitions[header.id] = std::move(definition);
+            break;
+        }
+        case record_kind_t::event:
+        {
+            event_header_t header{};
+            if (!reader.get(header))
+            {
+                error = "truncated event";
+                return false;
+            }
+            const auto known = definitions.find(header.id);
+            if (known == definitions.end())
+            {
+                error = "event without definition";
+                return false;
+            }
+            event_t event{ header.core, header.id, header.timestamp, {} };
+            if (!read_args(reader, known->second.schema, event.args))
+            {
+                error = "truncated event arguments";
+                return false;
+            }
+            events.push_back(std::move(event));
+            break;
+        }
+        case record_kind_t::dropped:
+        {
+            dropped_header_t header{};
+            if (!reader.get(header))
+            {
+                error = "truncated drop counter";
+                return false;
+            }
+            dropped[header.core] += header.count;
+            break;
+        }
+        default:
+            // Rest of a dump buffer that wasn't filled.
+            //
+            if (data[reader.offset] == 0)
+                return true;
+            error = "unknown record kind " + std::to_string(data[reader.offset]);
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string decoder_t::message(const event_t& event) const
+{
+    const auto known = definition(event.id);
+    return known != nullptr ? format(known->format, event.args) : "<undefined event>";
+}
+
+std::vector<const event_t*> decoder_t::timeline(uint16_t core) const
+{
+    std::vector<const event_t*> result;
+    for (const auto& event : events)
+    {
+        if (event.core == core)
+            result.push_back(&event);
+    }
+    std::stable_sort(result.begin(), result.end(), [](const event_t* lhs, const event_t* rhs)
+    {
+        return lhs->timestamp < rhs->timestamp;
+    });
+    return result;
+}
+
+std::vector<rate_t> decoder_t::rates() const
+{
+    std::map<uint32_t, rate_t> by_id;
+    for (const auto& event : events)
+    {
+        auto [entry, inserted] = by_id.try_emplace(event.id, rate_t{ event.id, 0, event.timestamp, event.timestamp });
+        auto& rate = entry->second;
+        rate.count++;
+        rate.first = std::min(rate.first, event.timestamp);
+        rate.last  = std::max(rate.last,  event.timestamp);
+    }
+
+    std::vector<rate_t> result;
+    for (const auto& [id, rate] : by_id)
+    {
+        result.push_back(rate);
+    }
+    std::stable_sort(result.begin(), result.end(), [](const rate_t& lhs, const rate_t& rhs)
+    {
+        return lhs.count > rhs.count;
+    });
+    return result;
+}
+
+const definition_t* decoder_t::definition(uint32_t id) const
+{
+    const auto known = definitions.find(id);
+    return known != definitions.end() ? &known->second : nullptr;
+}
+
+/// Check if the conversion prints the stored argument type. Format strings come from the dump,
+/// so anything else (e.g. `%n` or `%s` of an integer) must never reach snprintf.
+///
+static bool accepts(arg_t type, char conversion)
+{
+    switch (type)
+    {
+    case arg_t::string:
+        return conversion == 's';
+    case arg_t::pointer:
+        return conversion == 'p';
+    case arg_t::i32:
+    case arg_t::u32:
+    case arg_t::i64:
+    case arg_t::u64:
+        return conversion != '\0' && std::strchr("diuxXoc", conversion) != nullptr;
+    default:
+        return false;
+    }
+}
+
+std::string format(const std::string& format, const std::vector<arg_value_t>& args)
+{
+    std::string result;
+    size_t      next = 0;
+
+    for (size_t i = 0; i < format.size(); i++)
+    {
+        if (format[i] != '%')
+        {
+            result += format[i];
+            continue;
+        }
+        if (i + 1 < format.size() && format[i + 1] == '%')
+        {
+            result += '%';
+            i++;
+            continue;
+        }
+        // Keep flags, width and precision, drop the Windows length modifier and
+        // use the host one matching the stored argument size.
+        //
+        std::string spec = "%";
+        i++;
+        while (i < format.size() && std::strchr("-+ #0123456789.", format[i]) != nullptr)
+            spec += format[i++];
+        while (i < format.size() && std::strchr("hlIzjt3624", format[i]) != nullptr && std::strchr("diuxXocps", format[i]) == nullptr)
+            i++;
+        if (i >= format.size() || next >= args.size())
+        {
+            result += "<bad format>";
+            break;
+        }
+
+        const auto  conversion = format[i];
+        const auto& arg        = args[next++];
+        if (!accepts(arg.type, conversion))
+        {
+            result += "<bad format>";
+            continue;
+        }
+
+        char buffer[512];
+        switch (arg.type)
+        {
+        case arg_t::string:
+            std::snprintf(buffer, sizeof(buffer), (spec + 's').c_str(), arg.string.c_str());
+            break;
+        case arg_t::pointer:
+            std::snprintf(buffer, sizeof(buffer), "0x%016" PRIx64, arg.value);
+            break;
+        default:
+            if (conversion == 'c')
+                std::snprintf(buffer, sizeof(buffer), (spec + 'c').c_str(), static_cast<int>(arg.value));
+            else if (arg.type == arg_t::i32 || arg.type == arg_t::i64)
+                std::snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(), static_cast<long long>(arg.value));
+            else
+                std::snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(), static_cast<unsigned long long>(arg.value));
+            break;
+        }
+        result += buffer;
+    }
+    return result;
+}
+};
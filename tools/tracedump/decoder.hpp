@@ -0,0 +1,86 @@
+#pragma once
+#include "heye/shared/trace_format.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace heye::trace
+{
+/// Format string, argument schema, level and category of an event id.
+///
+struct definition_t
+{
+    uint32_t    id;
+    uint32_t    schema;
+    level_t     level;
+    category_t  category;
+    std::string format;
+};
+
+/// Decoded argument. Strings are copied into the stream by the driver.
+///
+struct arg_value_t
+{
+    arg_t       type;
+    uint64_t    value;
+    std::string string;
+};
+
+struct event_t
+{
+    uint16_t                 core;
+    uint32_t                 id;
+    uint64_t                 timestamp;
+    std::vector<arg_value_t> args;
+};
+
+/// Per event id statistics over the whole trace.
+///
+struct rate_t
+{
+    uint32_t id;
+    uint64_t count;
+    uint64_t first;
+    uint64_t last;
+};
+
+/// Decoder of dumped trace chunks. Chunks may be fed one by one or concatenated.
+///
+struct decoder_t
+{
+    /// Decode every chunk in the buffer. Returns `false` and sets `error` on malformed input,
+    /// events decoded before the error are kept.
+    ///
+    bool feed(const uint8_t* data, size_t size);
+
+    /// Reconstruct message of the event from its format string.
+    ///
+    std::string message(const event_t& event) const;
+
+    /// Events of the core ordered by timestamp.
+    ///
+    std::vector<const event_t*> timeline(uint16_t core) const;
+
+    /// Statistics of every event id ordered by count, most frequent first.
+    ///
+    std::vector<rate_t> rates() const;
+
+    /// Format string of the event id or `nullptr` if it wasn't defined.
+    ///
+    const definition_t* definition(uint32_t id) const;
+
+    std::vector<event_t>             events;
+    std::map<uint32_t, definition_t> definitions;
+    std::map<uint16_t, uint64_t>     dropped;
+    uint16_t                         cores         = 0;
+    uint64_t                         tsc_frequency = 0;
+    std::string                      error;
+};
+
+/// Format printf conversion with Windows argument sizes on the host.
+///
+std::string format(const std::string& format, const std::vector<arg_value_t>& args);
+};
@@ -0,0 +1,152 @@
+#include "decoder.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+/// heye-tracedump [--messages | --timeline | --rates] [--tsc-hz <frequency>] <dump>...
+///
+/// Decodes files with chunks written by `heye::logger::dump`.
+///
+enum class output_t
+{
+    messages,
+    timeline,
+    rates
+};
+
+static void usage()
+{
+    std::fprintf(stderr, "usage: heye-tracedump [--messages | --timeline | --rates] [--tsc-hz <frequency>] <dump>...\n");
+}
+
+static void print_messages(const heye::trace::decoder_t& decoder)
+{
+    for (const auto& event : decoder.events)
+    {
+        const auto definition = decoder.definition(event.id);
+        std::printf("[%3u] %20" PRIu64 " %-5s %-7s %s\n", event.core, event.timestamp,
+            heye::trace::level_name(definition->level), heye::trace::category_name(definition->category), decoder.message(event).c_str());
+    }
+}
+
+static void print_timeline(const heye::trace::decoder_t& decoder)
+{
+    for (uint16_t core = 0; core < decoder.cores; core++)
+    {
+        const auto events = decoder.timeline(core);
+        const auto lost   = decoder.dropped.find(core);
+        if (events.empty() && lost == decoder.dropped.end())
+            continue;
+
+        std::printf("core %u: %zu events, %" PRIu64 " dropped\n", core, events.size(), lost != decoder.dropped.end() ? lost->second : 0);
+
+        uint64_t previous = events.empty() ? 0 : events.front()->timestamp;
+        for (const auto event : events)
+        {
+            std::printf("  %+16" PRId64 "  %s\n", static_cast<int64_t>(event->timestamp - previous), decoder.message(*event).c_str());
+            previous = event->timestamp;
+        }
+    }
+}
+
+static void print_rates(const heye::trace::decoder_t& decoder)
+{
+    uint64_t first = UINT64_MAX;
+    uint64_t last  = 0;
+    for (const auto& event : decoder.events)
+    {
+        first = std::min(first, event.timestamp);
+        last  = std::max(last,  event.timestamp);
+    }
+
+    const auto span    = decoder.events.empty() ? 0 : last - first;
+    const auto seconds = decoder.tsc_frequency != 0 ? static_cast<double>(span) / static_cast<double>(decoder.tsc_frequency) : 0.0;
+
+    if (seconds > 0)
+        std::printf("%zu events over %.3f s\n", decoder.events.size(), seconds);
+    else
+        std::printf("%zu events over %" PRIu64 " cycles (TSC frequency unknown, pass --tsc-hz)\n", decoder.events.size(), span);
+
+    std::printf("%12s %14s  %s\n", "count", seconds > 0 ? "per second" : "per Mcycle", "event");
+    for (const auto& rate : decoder.rates())
+    {
+        const auto per_unit = seconds > 0
+            ? static_cast<double>(rate.count) / seconds
+            : static_cast<double>(rate.count) * 1e6 / static_cast<double>(span != 0 ? span : 1);
+        const auto definition = decoder.definition(rate.id);
+        std::printf("%12" PRIu64 " %14.2f  %s\n", rate.count, per_unit, definition != nullptr ? definition->format.c_str() : "?");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    auto     mode = output_t::messages;
+    uint64_t tsc_frequency{};
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--messages") == 0)
+            mode = output_t::messages;
+        else if (std::strcmp(argv[i], "--timeline") == 0)
+            mode = output_t::timeline;
+        else if (std::strcmp(argv[i], "--rates") == 0)
+            mode = output_t::rates;
+        else if (std::strcmp(argv[i], "--tsc-hz") == 0 && i + 1 < argc)
+            tsc_frequency = std::strtoull(argv[++i], nullptr, 0);
+        else if (argv[i][0] == '-')
+        {
+            usage();
+            return 2;
+        }
+        else
+            files.push_back(argv[i]);
+    }
+
+    if (files.empty())
+    {
+        usage();
+        return 2;
+    }
+
+    heye::trace::decoder_t decoder;
+    for (const auto& file : files)
+    {
+        std::ifstream stream(file, std::ios::binary);
+        if (!stream)
+        {
+            std::fprintf(stderr, "%s: can't open\n", file.c_str());
+            return 1;
+        }
+
+        const std::vector<uint8_t> data{ std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>() };
+        if (!decoder.feed(data.data(), data.size()))
+        {
+            std::fprintf(stderr, "%s: %s\n", file.c_str(), decoder.error.c_str());
+            return 1;
+        }
+    }
+
+    if (tsc_frequency != 0)
+        decoder.tsc_frequency = tsc_frequency;
+
+    switch (mode)
+    {
+    case output_t::messages:
+        print_messages(decoder);
+        break;
+    case output_t::timeline:
+        print_timeline(decoder);
+        break;
+    case output_t::rates:
+        print_rates(decoder);
+        break;
+    }
+    return 0;
+}